@@ -0,0 +1,211 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "model_renderer.h"
+#include "profiler.h"
+
+// builds geometries on worker threads and uploads them on the GL thread, a few per frame,
+// so the scene appears progressively instead of the window freezing until everything is loaded.
+//
+//   loader.load([]() -> IGeometry * { return new SphereGeometry(...); }, &head, "head");
+//   while (...) { loader.update(ASSET_UPLOAD_BUDGET_MS); if (head) head->render(); ... }
+//
+// the target pointer stays NULL until the renderer is created; the loader owns the renderers
+// and must be destroyed while the GL context is current. the factory hands the geometry over:
+// it moves into the renderer, which releases it right after the upload unless retention is KEEP_GEOMETRY.
+class AssetLoader
+{
+    public:
+    // threads <= 0: one per core, leaving one for the GL thread
+    explicit AssetLoader(int threads = 0) : m_pending(0), m_stop(false)
+    {
+        if (threads <= 0)
+            threads = std::max(1, int(std::thread::hardware_concurrency()) - 1);
+        for (int i = 0; i < threads; i++)
+            m_workers.push_back(std::thread(&AssetLoader::work, this));
+    }
+
+    ~AssetLoader()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (size_t i = 0; i < m_workers.size(); i++)
+            m_workers[i].join();
+
+        for (size_t i = 0; i < m_renderers.size(); i++)
+            delete m_renderers[i];
+    }
+
+    // factory runs on a worker and returns a new geometry; *target is set by update() on the GL thread.
+    // name labels the renderer and must outlive it, format is its GPU vertex format.
+    void load(std::function<IGeometry * ()> factory, ModelRenderer ** target, const char * name, const VertexFormat & format = VertexFormat(),
+              GeometryRetention retention = RELEASE_GEOMETRY)
+    {
+        Job job;
+        job.factory = factory;
+        job.target = target;
+        job.name = name;
+        job.format = format;
+        job.retention = retention;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_jobs.push_back(std::move(job));
+            m_pending++;
+        }
+        m_wake.notify_one();
+    }
+
+    // data that is not a geometry (instance buffers): build runs on a worker, then upload on the GL
+    // thread in update() or finish(), like the renderers
+    void loadData(std::function<void()> build, std::function<void()> upload)
+    {
+        Job job;
+        job.build = build;
+        job.upload = upload;
+        job.target = NULL;
+        job.name = NULL;
+        job.retention = RELEASE_GEOMETRY;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_jobs.push_back(std::move(job));
+            m_pending++;
+        }
+        m_wake.notify_one();
+    }
+
+    // GL thread: uploads built geometries until budget_ms is spent, at least one per call if any is ready.
+    // returns the number of assets uploaded.
+    int update(double budget_ms)
+    {
+        PROFILE_ZONE("AssetLoader::update");
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int uploaded = 0;
+        for (;;)
+        {
+            Job job;
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                if (m_built.empty())
+                    break;
+                job = std::move(m_built.front());
+                m_built.pop_front();
+            }
+
+            upload(job);
+            uploaded++;
+
+            if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budget_ms)
+                break;
+        }
+        return uploaded;
+    }
+
+    // GL thread: blocks until every queued asset is built and uploaded
+    void finish()
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_done.wait(lock, [this]() { return !m_built.empty() || m_pending == 0; });
+                if (m_built.empty())
+                    return;
+                job = std::move(m_built.front());
+                m_built.pop_front();
+            }
+            upload(job);
+        }
+    }
+
+    // assets queued and not uploaded yet
+    int pending()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return m_pending;
+    }
+
+    private:
+    struct Job
+    {
+        std::function<IGeometry * ()> factory;
+        ModelRenderer ** target;
+        const char * name;
+        VertexFormat format;
+        GeometryRetention retention;
+        std::unique_ptr<IGeometry> geometry; // built, moves into the renderer
+        std::function<void()> build;         // loadData() jobs, instead of factory
+        std::function<void()> upload;
+    };
+
+    void work()
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_wake.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+                if (m_stop)
+                    return;
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+
+            {
+                PROFILE_ZONE("AssetLoader::build");
+                if (job.factory)
+                    job.geometry.reset(job.factory());
+                else
+                    job.build();
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                m_built.push_back(std::move(job));
+            }
+            m_done.notify_all();
+        }
+    }
+
+    void upload(Job & job)
+    {
+        if (job.upload)
+            job.upload();
+        else
+        {
+            ModelRenderer * renderer = new ModelRenderer(std::move(job.geometry), job.name, job.format, job.retention);
+            m_renderers.push_back(renderer);
+            *job.target = renderer;
+        }
+
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_pending--;
+        m_done.notify_all();
+    }
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_lock;
+    std::condition_variable m_wake; // jobs queued or stop
+    std::condition_variable m_done; // geometry built or uploaded
+    std::deque<Job> m_jobs;         // waiting for a worker
+    std::deque<Job> m_built;        // waiting for the GL thread
+    int m_pending;                  // queued and not uploaded yet
+    bool m_stop;
+
+    std::vector<ModelRenderer *> m_renderers; // GL thread only
+};
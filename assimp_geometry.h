@@ -3,7 +3,9 @@
 #include <glad/glad.h>
 
 #include "model_renderer.h"
+#include "parallel_for.h"
 
+#include <cstring>
 #include <vector>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -29,65 +31,99 @@ public:
             return;
         }
 
-        for (unsigned i = 0; i < scene->mNumMeshes; i++)
-          loadMesh(scene->mMeshes[i]);
-
-        m_faces_size = m_faces.size() / 3;
-        m_vertices_size = m_vertices.size() / 3;
+        loadScene(scene);
     }
 
     ~AssimpGeometry()
     {
     }
 
-    void loadMesh(aiMesh *mesh)
+    // merges all the meshes of the scene in two passes: a prefix sum over the per-mesh vertex and
+    // triangle counts gives every mesh its slice of the output arrays, sized once, then the slices
+    // are filled in parallel. the attribute checks are made per mesh, not per vertex.
+    void loadScene(const aiScene * scene)
     {
-        unsigned start = m_vertices.size() / 3;
-        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        const size_t mesh_count = scene->mNumMeshes;
+        std::vector<size_t> vertex_start(mesh_count + 1, 0);
+        std::vector<size_t> index_start(mesh_count + 1, 0);
+
+        // pass 1: counts (faces other than triangles are skipped), then offsets
+        parallel_for(mesh_count, [&](size_t m) {
+            const aiMesh * mesh = scene->mMeshes[m];
+            size_t triangles = 0;
+            for (unsigned f = 0; f < mesh->mNumFaces; f++)
+                triangles += mesh->mFaces[f].mNumIndices == 3;
+            vertex_start[m + 1] = mesh->mNumVertices;
+            index_start[m + 1] = triangles * 3;
+        });
+        for (size_t m = 0; m < mesh_count; m++)
         {
-            m_vertices.push_back(mesh->mVertices[i].x);
-            m_vertices.push_back(mesh->mVertices[i].y);
-            m_vertices.push_back(mesh->mVertices[i].z);
+            vertex_start[m + 1] += vertex_start[m];
+            index_start[m + 1] += index_start[m];
+            m_any_color = m_any_color || scene->mMeshes[m]->mColors[0] != NULL;
+            m_any_texcoord = m_any_texcoord || scene->mMeshes[m]->mTextureCoords[0] != NULL;
+        }
 
-            m_normals.push_back(mesh->mNormals[i].x);
-            m_normals.push_back(mesh->mNormals[i].y);
-            m_normals.push_back(mesh->mNormals[i].z);
+        const size_t vertices_size = vertex_start[mesh_count];
+        m_vertices.resize(vertices_size * 3);
+        m_normals.resize(vertices_size * 3);
+        m_colors.resize(m_any_color ? vertices_size * 3 : 0);       // zero for meshes without colors
+        m_texcoords.resize(m_any_texcoord ? vertices_size * 2 : 0); // zero for meshes without texcoords
+        m_faces.resize(index_start[mesh_count]);
 
-            if (mesh->mColors[0])
-            {
-                m_colors.push_back(mesh->mColors[0][i].r);
-                m_colors.push_back(mesh->mColors[0][i].g);
-                m_colors.push_back(mesh->mColors[0][i].b);
-                m_any_color = true;
-            }
-            else
-            {
-                m_colors.push_back(0.0f);
-                m_colors.push_back(0.0f);
-                m_colors.push_back(0.0f);
-            }
+        // pass 2: every mesh fills its own slice
+        parallel_for(mesh_count, [&](size_t m) {
+            loadMesh(scene->mMeshes[m], vertex_start[m], index_start[m]);
+        });
+
+        m_faces_size = m_faces.size() / 3;
+        m_vertices_size = m_vertices.size() / 3;
+    }
 
-            if (mesh->mTextureCoords[0])
+    void loadMesh(const aiMesh * mesh, size_t start, size_t index_start)
+    {
+        static_assert(sizeof(aiVector3D) == 3 * sizeof(GLfloat), "aiVector3D is copied as 3 floats");
+        const size_t count = mesh->mNumVertices;
+        if (count == 0)
+            return;
+
+        memcpy(&m_vertices[start * 3], mesh->mVertices, count * 3 * sizeof(GLfloat));
+        if (mesh->mNormals) // points and lines get no normals from aiProcess_GenNormals
+            memcpy(&m_normals[start * 3], mesh->mNormals, count * 3 * sizeof(GLfloat));
+
+        if (mesh->mColors[0])
+        {
+            const aiColor4D * colors = mesh->mColors[0];
+            GLfloat * out = &m_colors[start * 3];
+            for (size_t i = 0; i < count; i++)
             {
-                m_texcoords.push_back(mesh->mTextureCoords[0][i].x);
-                m_texcoords.push_back(mesh->mTextureCoords[0][i].y);
-                m_any_texcoord = true;
+                out[i * 3 + 0] = colors[i].r;
+                out[i * 3 + 1] = colors[i].g;
+                out[i * 3 + 2] = colors[i].b;
             }
-            else
+        }
+
+        if (mesh->mTextureCoords[0])
+        {
+            const aiVector3D * texcoords = mesh->mTextureCoords[0];
+            GLfloat * out = &m_texcoords[start * 2];
+            for (size_t i = 0; i < count; i++)
             {
-                m_texcoords.push_back(0.0f);
-                m_texcoords.push_back(0.0f);
+                out[i * 2 + 0] = texcoords[i].x;
+                out[i * 2 + 1] = texcoords[i].y;
             }
         }
 
-
-        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        GLuint * faces = &m_faces[index_start];
+        for (unsigned i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace & face = mesh->mFaces[i];
             if (face.mNumIndices != 3)
                 continue;
-            for (unsigned int j = 0; j < face.mNumIndices; j++)
-                m_faces.push_back(start + face.mIndices[j]);
+            faces[0] = GLuint(start + face.mIndices[0]);
+            faces[1] = GLuint(start + face.mIndices[1]);
+            faces[2] = GLuint(start + face.mIndices[2]);
+            faces += 3;
         }
     }
 
@@ -101,6 +137,13 @@ public:
 
     GLenum type() { return GL_TRIANGLES; }
 
+    // meshes without colors or texcoords hold zeros when another mesh of the scene has them
+    size_t residentBytes()
+    {
+        return (m_vertices.capacity() + m_colors.capacity() + m_normals.capacity() + m_texcoords.capacity()) * sizeof(GLfloat) +
+               m_faces.capacity() * sizeof(GLuint);
+    }
+
 private:
     std::vector<GLfloat> m_vertices;
     std::vector<GLfloat> m_colors;
@@ -0,0 +1,451 @@
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "model_renderer.h"
+#include "assimp_geometry.h"
+#include "ply_geometry.h"
+#include "mesh_optimizer.h"
+#include "sphere_geometry.h"
+#include "cylinder_geometry.h"
+#include "cone_geometry.h"
+#include "init_offscreen.h"
+#include "offscreen_framebuffer.h"
+#include "stream_buffer.h"
+#include "transform_batch.h"
+#include "flock.h"
+
+// micro-benchmark of geometry construction, interleaving and upload.
+// runs on a surfaceless software context so it can run on CI machines without a GPU.
+// the streams section times per-frame dynamic vertex updates drawn right after: StreamBuffer in
+// each mode against glBufferSubData into a buffer the previous frame is still reading.
+// the transforms section compares the per-draw glm matrix chain (with the normal matrix inverse
+// the vertex shader used to do per vertex) with transform_batch().
+// the flock section times Flock::step() (grid rebuild and forces) and reports birds updated per second.
+// the flock_check section steps a small dense flock with the grid and with an O(n^2) neighbour
+// search side by side; the exit status is 1 if they drift apart.
+// usage: bench_geometry [--iterations N] [--ply path]
+// prints one JSON document on stdout, times are in milliseconds.
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Timing
+{
+    double min;
+    double median;
+    double mean;
+};
+
+static Timing summarize(std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (size_t i = 0; i < samples.size(); i++)
+        sum += samples[i];
+    Timing t;
+    t.min = samples.front();
+    t.median = samples[samples.size() / 2];
+    t.mean = sum / samples.size();
+    return t;
+}
+
+static void printTiming(const char * name, const Timing & t)
+{
+    std::cout << "\"" << name << "\": {\"min\": " << t.min << ", \"median\": " << t.median << ", \"mean\": " << t.mean << "}";
+}
+
+template <typename Factory>
+static void benchGeometry(const std::string & name, int level, int iterations, Factory factory, bool & first)
+{
+    std::vector<double> construct, interleave, upload;
+
+    IGeometry * geo = NULL;
+    for (int it = 0; it < iterations; it++)
+    {
+        delete geo;
+        double t0 = now_ms();
+        geo = factory();
+        construct.push_back(now_ms() - t0);
+    }
+
+    // pre-interleaved geometries are uploaded as they are
+    const VertexLayout layout = geo->vertexLayout() ? *geo->vertexLayout() : ModelRenderer::interleavedLayout(*geo);
+    const size_t interleaved_bytes = size_t(geo->verticesSize()) * layout.stride;
+    if (geo->vertexLayout())
+        interleave.push_back(0.0);
+    else
+    {
+        GLfloat * vertices = new GLfloat[geo->verticesSize() * ModelRenderer::interleavedStride(*geo)];
+        for (int it = 0; it < iterations; it++)
+        {
+            double t0 = now_ms();
+            ModelRenderer::interleave(*geo, vertices);
+            interleave.push_back(now_ms() - t0);
+        }
+        delete[] vertices;
+    }
+
+    // index optimization, timed once: it is much slower than the rest and runs on the loader workers
+    const double optimize_start = now_ms();
+    OptimizedGeometry optimized(*geo);
+    const double optimize_ms = now_ms() - optimize_start;
+
+    // full renderer construction: interleave + VBO/EBO upload + VAO setup, synchronized with glFinish
+    for (int it = 0; it < iterations; it++)
+    {
+        glFinish();
+        double t0 = now_ms();
+        {
+            ModelRenderer renderer(*geo);
+            glFinish();
+            upload.push_back(now_ms() - t0);
+        }
+    }
+
+    if (!first)
+        std::cout << "," << std::endl;
+    first = false;
+
+    std::cout << "    {\"geometry\": \"" << name << "\", \"level\": " << level
+              << ", \"vertices\": " << geo->verticesSize()
+              << ", \"indices\": " << geo->size()
+              << ", \"cpu_bytes\": " << geo->residentBytes()
+              << ", \"interleaved_bytes\": " << interleaved_bytes
+              << ", \"gpu_bytes\": " << interleaved_bytes + geo->size() * (geo->verticesSize() < 65536 ? sizeof(GLushort) : sizeof(GLuint))
+              << ", \"optimize_ms\": " << optimize_ms
+              << ", \"acmr\": {\"before\": " << optimized.statsBefore().acmr << ", \"after\": " << optimized.statsAfter().acmr << "}"
+              << ", \"atvr\": {\"before\": " << optimized.statsBefore().atvr << ", \"after\": " << optimized.statsAfter().atvr << "}, ";
+    printTiming("construct_ms", summarize(construct));
+    std::cout << ", ";
+    printTiming("interleave_ms", summarize(interleave));
+    std::cout << ", ";
+    printTiming("renderer_ms", summarize(upload));
+    std::cout << "}";
+
+    delete geo;
+}
+
+static GLuint compileShader(GLenum type, const char * source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    return shader;
+}
+
+// points from a vec4 stream, enough to make the GPU read the data
+static GLuint createPointProgram()
+{
+    const char * vertex_source =
+        "#version 330 core\n"
+        "layout (location = 0) in vec4 position;\n"
+        "void main() { gl_Position = vec4(position.xyz, 1.0); gl_PointSize = 1.0; }\n";
+    const char * fragment_source =
+        "#version 330 core\n"
+        "out vec4 color;\n"
+        "void main() { color = vec4(1.0); }\n";
+    GLuint program = glCreateProgram();
+    GLuint vertex_shader = compileShader(GL_VERTEX_SHADER, vertex_source);
+    GLuint fragment_shader = compileShader(GL_FRAGMENT_SHADER, fragment_source);
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    return program;
+}
+
+// mode < 0: glBufferSubData baseline
+static void benchStream(const char * name, int mode, size_t points, int frames, bool & first)
+{
+    const size_t bytes = points * 4 * sizeof(GLfloat);
+    StreamBuffer * stream = mode >= 0 ? new StreamBuffer(bytes, StreamMode(mode)) : NULL;
+    GLuint buffer = 0;
+    if (!stream)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_DYNAMIC_DRAW);
+    }
+
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, stream ? stream->buffer() : buffer);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    std::vector<GLfloat> scratch(stream ? 0 : points * 4);
+    std::vector<double> frame_ms;
+    glFinish();
+    const double start = now_ms();
+    for (int f = 0; f < frames; f++)
+    {
+        const double t0 = now_ms();
+        GLfloat * p = stream ? (GLfloat *)stream->map(bytes) : scratch.data();
+        for (size_t i = 0; i < points; i++)
+        {
+            const float x = float(i % 1024) / 512.0f - 1.0f;
+            p[i * 4 + 0] = x;
+            p[i * 4 + 1] = float(f % 64) / 32.0f - 1.0f;
+            p[i * 4 + 2] = 0.0f;
+            p[i * 4 + 3] = 1.0f;
+        }
+        GLint first_vertex = 0;
+        if (stream)
+        {
+            stream->unmap(bytes);
+            first_vertex = GLint(stream->lastOffset() / (4 * sizeof(GLfloat)));
+        }
+        else
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, p);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDrawArrays(GL_POINTS, first_vertex, GLsizei(points));
+        if (stream)
+            stream->endFrame();
+        frame_ms.push_back(now_ms() - t0);
+    }
+    glFinish();
+    const double total_ms = now_ms() - start;
+
+    glBindVertexArray(0);
+    glDeleteVertexArrays(1, &vao);
+    delete stream;
+    glDeleteBuffers(1, &buffer);
+
+    if (!first)
+        std::cout << "," << std::endl;
+    first = false;
+    std::cout << "    {\"stream\": \"" << name << "\", \"bytes_per_frame\": " << bytes << ", \"frames\": " << frames << ", ";
+    printTiming("cpu_frame_ms", summarize(frame_ms));
+    std::cout << ", \"total_ms\": " << total_ms << "}";
+}
+
+static void benchTransforms(size_t count, int iterations, bool & first)
+{
+    const glm::mat4 projection = glm::perspective(glm::pi<float>() / 4.0f, 1.0f, 1.0f, 75.0f);
+    const glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -35.0f));
+    std::vector<glm::mat4> models(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(float(i % 32), float(i / 32 % 32), -float(i / 1024)));
+        model = glm::rotate(model, float(i) * 0.1f, glm::vec3(0.0f, 0.0f, 1.0f));
+        models[i] = glm::scale(model, glm::vec3(1.0f, 1.0f + float(i % 3), 0.5f));
+    }
+
+    std::vector<ObjectConstants> per_draw(count), batched(count);
+    std::vector<double> per_draw_ms, batch_ms;
+    for (int it = 0; it < iterations; it++)
+    {
+        double t0 = now_ms();
+        for (size_t i = 0; i < count; i++)
+        {
+            per_draw[i].modelview = view * models[i];
+            per_draw[i].transformation = projection * per_draw[i].modelview;
+            const glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(per_draw[i].modelview)));
+            for (int c = 0; c < 3; c++)
+                per_draw[i].normal_matrix[c] = glm::vec4(normal_matrix[c], 0.0f);
+        }
+        per_draw_ms.push_back(now_ms() - t0);
+
+        t0 = now_ms();
+        transform_batch(projection, view, models.data(), count, batched.data(), sizeof(ObjectConstants));
+        batch_ms.push_back(now_ms() - t0);
+    }
+
+    // largest difference between the two, relative to the magnitude of the matrices
+    float max_error = 0.0f;
+    for (size_t i = 0; i < count; i++)
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+            {
+                max_error = std::max(max_error, std::fabs(per_draw[i].transformation[c][r] - batched[i].transformation[c][r]) /
+                                                    std::max(1.0f, std::fabs(per_draw[i].transformation[c][r])));
+                if (c < 3 && r < 3)
+                    max_error = std::max(max_error, std::fabs(per_draw[i].normal_matrix[c][r] - batched[i].normal_matrix[c][r]));
+            }
+
+    if (!first)
+        std::cout << "," << std::endl;
+    first = false;
+    std::cout << "    {\"draws\": " << count << ", \"max_error\": " << max_error << ", ";
+    printTiming("per_draw_ms", summarize(per_draw_ms));
+    std::cout << ", ";
+    printTiming("batch_ms", summarize(batch_ms));
+    std::cout << "}";
+}
+
+static void benchFlock(size_t count, int iterations, bool & first)
+{
+    Flock flock(count);
+    const float dt = 1.0f / 60.0f;
+    for (int it = 0; it < 10; it++) // let the initial spread settle into the flock
+        flock.step(dt);
+
+    std::vector<double> step_ms;
+    for (int it = 0; it < iterations; it++)
+    {
+        const double t0 = now_ms();
+        flock.step(dt);
+        step_ms.push_back(now_ms() - t0);
+    }
+
+    std::vector<BirdInstance> birds(count);
+    std::vector<double> write_ms;
+    for (int it = 0; it < iterations; it++)
+    {
+        const double t0 = now_ms();
+        flock.write(birds.data());
+        write_ms.push_back(now_ms() - t0);
+    }
+
+    const Timing step = summarize(step_ms);
+    if (!first)
+        std::cout << "," << std::endl;
+    first = false;
+    std::cout << "    {\"birds\": " << count << ", \"threads\": " << parallel_for_threads()
+              << ", \"birds_per_second\": " << double(count) / (step.median / 1000.0) << ", ";
+    printTiming("step_ms", step);
+    std::cout << ", ";
+    printTiming("write_ms", summarize(write_ms));
+    std::cout << "}";
+}
+
+// max distance between the birds of a grid flock and of a brute force one, after steps steps
+static bool checkFlock(size_t count, int steps, bool & first)
+{
+    FlockParams params;
+    params.max_neighbours = int(count); // no cap, so both find every neighbour
+    params.density = 0.2f;              // about 25 neighbours per bird
+    Flock grid(count, 1, params);
+    Flock brute_force(count, 1, params);
+    const float dt = 1.0f / 60.0f;
+    float max_error = 0.0f;
+    for (int it = 0; it < steps; it++)
+    {
+        grid.step(dt);
+        brute_force.stepBruteForce(dt);
+        for (size_t i = 0; i < count; i++)
+            max_error = std::max(max_error, glm::length(grid.position(i) - brute_force.position(i)));
+    }
+
+    const bool pass = max_error < 1e-3f;
+    if (!first)
+        std::cout << "," << std::endl;
+    first = false;
+    std::cout << "    {\"birds\": " << count << ", \"steps\": " << steps << ", \"max_error\": " << max_error
+              << ", \"pass\": " << (pass ? "true" : "false") << "}";
+    return pass;
+}
+
+int main(int argc, char ** argv)
+{
+    int iterations = 20;
+    std::string ply_filename = "p10_tree.ply";
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+            iterations = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--ply") && i + 1 < argc)
+            ply_filename = argv[++i];
+        else
+        {
+            std::cout << "usage: " << argv[0] << " [--iterations N] [--ply path]" << std::endl;
+            return 1;
+        }
+    }
+
+    // prefer the software rasterizer unless the caller asked otherwise
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+    init_offscreen();
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"renderer\": \"" << (const char *)glGetString(GL_RENDERER) << "\"," << std::endl;
+    std::cout << "  \"iterations\": " << iterations << "," << std::endl;
+    std::cout << "  \"results\": [" << std::endl;
+
+    bool first = true;
+    const int levels[] = { 1, 4, 16, 64 };
+    for (int l = 0; l < 4; l++)
+    {
+        const int level = levels[l];
+        benchGeometry("sphere", level, iterations, [level]() -> IGeometry * {
+            return new SphereGeometry(0.5f, glm::vec3(0.5f), 24 * level, 24 * level);
+        }, first);
+        benchGeometry("cylinder", level, iterations, [level]() -> IGeometry * {
+            return new CylinderGeometry(0.5f, 3.0f, glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(1.0f), 30 * level);
+        }, first);
+        benchGeometry("cone", level, iterations, [level]() -> IGeometry * {
+            return new ConeGeometry(0.25f, 1.0f, glm::vec3(1.0f, 0.7f, 0.0f), glm::vec3(1.0f, 0.7f, 0.0f), 20 * level);
+        }, first);
+    }
+    benchGeometry("assimp:" + ply_filename, 1, iterations, [&ply_filename]() -> IGeometry * {
+        return new AssimpGeometry(ply_filename);
+    }, first);
+    benchGeometry("ply:" + ply_filename, 1, iterations, [&ply_filename]() -> IGeometry * {
+        return new PlyGeometry(ply_filename);
+    }, first);
+
+    std::cout << std::endl << "  ]," << std::endl;
+
+    std::cout << "  \"streams\": [" << std::endl;
+    {
+        OffscreenFramebuffer framebuffer(256, 256);
+        framebuffer.bind();
+        glViewport(0, 0, 256, 256);
+        GLuint program = createPointProgram();
+        glUseProgram(program);
+
+        first = true;
+        const size_t points = 1 << 16; // 1 MB per frame
+        const int frames = 20 * iterations;
+        benchStream("buffer_sub_data", -1, points, frames, first);
+        benchStream("orphan", STREAM_ORPHAN, points, frames, first);
+        if (gl_has_buffer_storage())
+            benchStream("persistent", STREAM_PERSISTENT, points, frames, first);
+
+        glUseProgram(0);
+        glDeleteProgram(program);
+    }
+    std::cout << std::endl << "  ]," << std::endl;
+
+    std::cout << "  \"transforms\": [" << std::endl;
+    first = true;
+    const size_t draws[] = { 64, 1024, 16384 };
+    for (int d = 0; d < 3; d++)
+        benchTransforms(draws[d], iterations, first);
+    std::cout << std::endl << "  ]," << std::endl;
+
+    std::cout << "  \"flock\": [" << std::endl;
+    first = true;
+    const size_t birds[] = { 1000, 10000, 100000 };
+    for (int b = 0; b < 3; b++)
+        benchFlock(birds[b], iterations, first);
+    std::cout << std::endl << "  ]," << std::endl;
+
+    std::cout << "  \"flock_check\": [" << std::endl;
+    first = true;
+    bool flock_pass = checkFlock(500, 30, first);
+    flock_pass = checkFlock(2000, 30, first) && flock_pass;
+    std::cout << std::endl << "  ]" << std::endl << "}" << std::endl;
+    buffer_arenas_release();
+    return flock_pass ? 0 : 1;
+}
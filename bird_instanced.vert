@@ -0,0 +1,44 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in vec3 aNormal;
+layout (location = 3) in vec2 aTexCoords;
+// the uniform blocks and decode_octahedral() come from shader_common.glsl
+
+// per bird (BirdInstance in bird_instances.h)
+layout (location = 4) in vec4 aBirdPosition; // xyz: position in the flock space, w: heading about z
+layout (location = 5) in vec4 aBirdMotion;   // x: wing angle, y: pitch, z: scale
+
+out vec2 vTexCoords;
+out vec3 vNormal;
+out vec3 vPosition;
+out vec3 vColor;
+out vec3 vTint;
+
+void main()
+{
+   vec3 pos = aPos * position_scale.xyz + position_offset.xyz;
+   vec3 normal = octahedral_normal ? decode_octahedral(aNormal.xy) : aNormal;
+
+   // the hierarchy of display_bird(): bird = translate(position) * rotate(heading, z) * rotate(pitch, y),
+   // then the wing hinge rotate(hinge * wing angle, x), then the part
+   float heading = aBirdPosition.w;
+   float pitch = aBirdMotion.y;
+   float wing = hinge.x * aBirdMotion.x;
+   mat3 yaw_rotation = mat3(cos(heading), sin(heading), 0.0, -sin(heading), cos(heading), 0.0, 0.0, 0.0, 1.0);
+   mat3 pitch_rotation = mat3(cos(pitch), 0.0, -sin(pitch), 0.0, 1.0, 0.0, sin(pitch), 0.0, cos(pitch));
+   mat3 wing_rotation = mat3(1.0, 0.0, 0.0, 0.0, cos(wing), sin(wing), 0.0, -sin(wing), cos(wing));
+   mat3 rotation = yaw_rotation * pitch_rotation * wing_rotation;
+
+   vec3 bird_pos = aBirdPosition.xyz + aBirdMotion.z * (rotation * (part * vec4(pos, 1.0)).xyz);
+   gl_Position = transformation * vec4(bird_pos, 1.0);
+   vec4 position = modelview * vec4(bird_pos, 1.0);
+   vPosition = position.xyz / position.w;
+   // rotations and the uniform scale keep their own inverse transpose, up to a factor normalize() removes
+   vNormal = normal_matrix * (rotation * (part_normal_matrix * normal));
+   if (has_texture)
+     vTexCoords = aTexCoords;
+   else
+     vColor = aColor;
+   vTint = vec3(1.0); // only the forest trees are tinted
+}
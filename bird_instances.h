@@ -0,0 +1,107 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstddef>
+
+#include "parallel_for.h"
+#include "shader_constants.h"
+#include "vertex_layout.h"
+
+// instanced birds: every bird of the flock is one BirdInstance in a per-frame instance buffer, and
+// each bird part (mouth, head, body, wings) draws all of them at once with bird_instanced.vert,
+// which applies the hierarchy of the single bird: the bird, the wing hinge, then the part.
+
+// state of one bird, locations 4 and 5 of bird_instanced.vert
+struct BirdInstance
+{
+    glm::vec4 position; // xyz: in the flock space, w: heading about z (radians)
+    glm::vec4 motion;   // x: wing angle, y: pitch, z: scale, w: unused
+};
+
+inline const VertexLayout & bird_instance_layout()
+{
+    static const VertexLayout layout = { GLsizei(sizeof(BirdInstance)), 2, {
+        { 4, 4, GL_FLOAT, GL_FALSE, 0 },
+        { 5, 4, GL_FLOAT, GL_FALSE, GLsizei(4 * sizeof(GLfloat)) },
+    } };
+    return layout;
+}
+
+enum BirdPart
+{
+    BIRD_MOUTH = 0,
+    BIRD_HEAD,
+    BIRD_BODY,
+    BIRD_WING_LEFT,
+    BIRD_WING_RIGHT,
+    BIRD_PART_COUNT
+};
+
+inline InstanceConstants bird_part(const glm::mat4 & part, float hinge)
+{
+    InstanceConstants constants = InstanceConstants();
+    constants.part = part;
+    const glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(part)));
+    for (int c = 0; c < 3; c++)
+        constants.part_normal_matrix[c] = glm::vec4(normal_matrix[c], 0.0f);
+    constants.hinge = glm::vec4(hinge, 0.0f, 0.0f, 0.0f);
+    return constants;
+}
+
+// Instance blocks of the parts, relative to the bird matrix
+inline const InstanceConstants * bird_parts()
+{
+    struct Parts
+    {
+        InstanceConstants parts[BIRD_PART_COUNT];
+        Parts()
+        {
+            const float half_pi = glm::pi<float>() / 2;
+            const glm::mat4 identity(1.0f);
+            parts[BIRD_MOUTH] = bird_part(glm::rotate(identity, half_pi, glm::vec3(0.0f, 1.0f, 0.0f)), 0.0f);
+            parts[BIRD_HEAD] = bird_part(glm::translate(identity, glm::vec3(-1.0f, 0.0f, 0.0f)), 0.0f);
+            parts[BIRD_BODY] = bird_part(glm::rotate(glm::translate(identity, glm::vec3(-3.0f, 0.0f, 0.0f)), half_pi, glm::vec3(0.0f, 1.0f, 0.0f)), 0.0f);
+            // the wings open in opposite directions
+            parts[BIRD_WING_LEFT] = bird_part(glm::scale(glm::translate(identity, glm::vec3(-3.0f, 1.25f, 0.0f)), glm::vec3(1.0f, 1.0f, 0.3f / 2.0f)), 1.0f);
+            parts[BIRD_WING_RIGHT] = bird_part(glm::scale(glm::translate(identity, glm::vec3(-3.0f, -1.25f, 0.0f)), glm::vec3(1.0f, 1.0f, 0.3f / 2.0f)), -1.0f);
+        }
+    };
+    static const Parts parts;
+    return parts.parts;
+}
+
+// fractional part of i times an irrational: a low-discrepancy sequence, 0 for bird 0
+inline float bird_sequence(size_t i, double step)
+{
+    const double x = double(i) * step;
+    return float(x - std::floor(x));
+}
+
+// the flock of the scene, a function of the animation state: bird 0 is the original bird, on the
+// circle of radius 7.5 at bird_angle; the others spread over rings around the tree with their own
+// radius, height, angle, size and wing beat phase. wing angles stay in [-pi/4, pi/4] like advance()'s.
+inline void write_bird_formation(BirdInstance * birds, size_t count, float bird_angle, float wing_angle)
+{
+    const float max_wing = glm::pi<float>() / 4.0f;
+    const float two_pi = 2.0f * glm::pi<float>();
+    parallel_for(count, [=](size_t i) {
+        const float radius = 7.5f + 12.0f * bird_sequence(i, 0.6180339887);
+        const float height = 16.0f * (bird_sequence(i, 0.7548776662) - (i ? 0.5f : 0.0f));
+        const float angle = bird_angle + two_pi * bird_sequence(i, 0.5698402910);
+        const float scale = 1.0f + 0.4f * (bird_sequence(i, 0.4142135624) - (i ? 0.5f : 0.0f));
+
+        // triangle wave through wing_angle, shifted by the bird's phase
+        const float t = std::fmod(wing_angle + max_wing + 4.0f * max_wing * bird_sequence(i, 0.3247179572), 4.0f * max_wing);
+        const float wing = t < 2.0f * max_wing ? t - max_wing : 3.0f * max_wing - t;
+
+        BirdInstance bird;
+        bird.position = glm::vec4(-radius * std::cos(angle), -radius * std::sin(angle), height, angle);
+        bird.motion = glm::vec4(wing, 0.0f, scale, 0.0f);
+        birds[i] = bird;
+    }, 4096);
+}
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "memory_stats.h"
+#include "vertex_layout.h"
+
+// shared GPU buffers for all the meshes with the same vertex layout and index type: one VAO over one
+// vertex buffer and one index buffer, meshes suballocated in whole vertices and indices and drawn with
+// glDrawElementsBaseVertex, so consecutive draws of different meshes bind nothing.
+//
+//   BufferArena & arena = buffer_arena_for(layout, GL_UNSIGNED_SHORT);
+//   BufferArena::Handle mesh = arena.allocate(vertices, vertex_count, indices, index_count);
+//   arena.draw(mesh, GL_TRIANGLES, 0, index_count);
+//   arena.free(mesh);
+//
+// when an allocation does not fit, the arena is compacted if the free space would be enough,
+// else it grows; both copy the live meshes on the GPU into new packed buffers. GL thread only.
+//
+// instanced draws go through a second VAO over the same buffers, whose per-instance attributes
+// (divisor 1) are pointed at the InstanceSource of the draw; consecutive draws from the same source
+// (the parts of a bird) only rebind it.
+
+// per-instance attributes of an instanced draw: count instances laid out as layout (locations
+// after the mesh's), read from buffer starting at offset bytes
+struct InstanceSource
+{
+    const VertexLayout * layout;
+    GLuint buffer;
+    size_t offset;
+    GLsizei count;
+};
+
+// first-fit free list of element ranges (vertices or indices) in [0, capacity)
+class ArenaFreeList
+{
+    public:
+    void reset(size_t capacity, size_t used = 0)
+    {
+        m_ranges.clear();
+        if (capacity > used)
+        {
+            const Range range = { used, capacity - used };
+            m_ranges.push_back(range);
+        }
+    }
+
+    bool allocate(size_t count, size_t & offset)
+    {
+        for (size_t i = 0; i < m_ranges.size(); i++)
+        {
+            if (m_ranges[i].count < count)
+                continue;
+            offset = m_ranges[i].offset;
+            m_ranges[i].offset += count;
+            m_ranges[i].count -= count;
+            if (m_ranges[i].count == 0)
+                m_ranges.erase(m_ranges.begin() + i);
+            return true;
+        }
+        return false;
+    }
+
+    // merges the range with its neighbours
+    void free(size_t offset, size_t count)
+    {
+        if (count == 0)
+            return;
+        size_t i = 0;
+        while (i < m_ranges.size() && m_ranges[i].offset < offset)
+            i++;
+        const Range range = { offset, count };
+        m_ranges.insert(m_ranges.begin() + i, range);
+        if (i + 1 < m_ranges.size() && m_ranges[i].offset + m_ranges[i].count == m_ranges[i + 1].offset)
+        {
+            m_ranges[i].count += m_ranges[i + 1].count;
+            m_ranges.erase(m_ranges.begin() + i + 1);
+        }
+        if (i > 0 && m_ranges[i - 1].offset + m_ranges[i - 1].count == m_ranges[i].offset)
+        {
+            m_ranges[i - 1].count += m_ranges[i].count;
+            m_ranges.erase(m_ranges.begin() + i);
+        }
+    }
+
+    size_t available() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < m_ranges.size(); i++)
+            total += m_ranges[i].count;
+        return total;
+    }
+
+    // number of free ranges: 1 (or 0 when full) once compacted
+    size_t fragments() const { return m_ranges.size(); }
+
+    private:
+    struct Range
+    {
+        size_t offset;
+        size_t count;
+    };
+    std::vector<Range> m_ranges; // sorted by offset, never adjacent
+};
+
+const size_t BUFFER_ARENA_INITIAL_BYTES = 1 << 20; // per buffer
+
+class BufferArena
+{
+    public:
+    typedef int Handle;
+
+    struct Allocation
+    {
+        size_t first_vertex;
+        size_t vertex_count;
+        size_t first_index;
+        size_t index_count;
+        bool live;
+    };
+
+    BufferArena(const VertexLayout & layout, GLenum index_type)
+        : m_layout(layout), m_index_type(index_type), m_vao(0), m_vbo(0), m_ebo(0), m_vertex_capacity(0), m_index_capacity(0),
+          m_instanced_vao(0), m_instance_layout(NULL), m_instance_buffer(0), m_instance_offset(0)
+    {
+        m_memory.name = "buffer_arena";
+        m_memory.cpu_resident = 0;
+        m_memory.gpu_vbo = 0;
+        m_memory.gpu_ebo = 0;
+        m_memory.peak_transient = 0;
+        memory_register(&m_memory);
+
+        glGenVertexArrays(1, &m_vao);
+        relocate(std::max<size_t>(1, BUFFER_ARENA_INITIAL_BYTES / m_layout.stride), BUFFER_ARENA_INITIAL_BYTES / indexSize());
+    }
+
+    ~BufferArena()
+    {
+        memory_unregister(&m_memory);
+        glDeleteVertexArrays(1, &m_vao);
+        if (m_instanced_vao)
+            glDeleteVertexArrays(1, &m_instanced_vao);
+        glDeleteBuffers(1, &m_vbo);
+        glDeleteBuffers(1, &m_ebo);
+    }
+
+    // copies the mesh into the arena; indices are relative to the mesh's first vertex
+    Handle allocate(const void * vertices, size_t vertex_count, const void * indices, size_t index_count)
+    {
+        Allocation allocation = { 0, vertex_count, 0, index_count, true };
+        if (!reserve(allocation))
+        {
+            const size_t used_vertices = m_vertex_capacity - m_vertex_free.available();
+            const size_t used_indices = m_index_capacity - m_index_free.available();
+            if (used_vertices + vertex_count <= m_vertex_capacity && used_indices + index_count <= m_index_capacity)
+                compact();
+            else
+                relocate(std::max(m_vertex_capacity * 2, used_vertices + vertex_count),
+                         std::max(m_index_capacity * 2, used_indices + index_count));
+            reserve(allocation);
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_vbo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.first_vertex * m_layout.stride, vertex_count * m_layout.stride, vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_ebo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.first_index * indexSize(), index_count * indexSize(), indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        Handle handle;
+        if (!m_free_handles.empty())
+        {
+            handle = m_free_handles.back();
+            m_free_handles.pop_back();
+            m_allocations[handle] = allocation;
+        }
+        else
+        {
+            handle = Handle(m_allocations.size());
+            m_allocations.push_back(allocation);
+        }
+        updateMemory();
+        return handle;
+    }
+
+    void free(Handle handle)
+    {
+        Allocation & allocation = m_allocations[handle];
+        m_vertex_free.free(allocation.first_vertex, allocation.vertex_count);
+        m_index_free.free(allocation.first_index, allocation.index_count);
+        allocation.live = false;
+        m_free_handles.push_back(handle);
+        updateMemory();
+    }
+
+    const Allocation & allocation(Handle handle) const { return m_allocations[handle]; }
+
+    // packs the live meshes at the start of the buffers, leaving a single free range in each
+    void compact() { relocate(m_vertex_capacity, m_index_capacity); }
+
+    // free ranges in the vertex and index buffers, 2 when compacted
+    size_t fragments() const { return m_vertex_free.fragments() + m_index_free.fragments(); }
+
+    // binds the vertex array every time: other code binds vertex arrays directly, a cached binding would go stale
+    void bind() const { glBindVertexArray(m_vao); }
+
+    // count indices of the mesh starting from its index start
+    void draw(Handle handle, GLenum mode, size_t start, size_t count) const
+    {
+        const Allocation & allocation = m_allocations[handle];
+        bind();
+        glDrawElementsBaseVertex(mode, GLsizei(count), m_index_type, (void *)((allocation.first_index + start) * indexSize()), GLint(allocation.first_vertex));
+    }
+
+    // instances.count copies of count indices of the mesh
+    void drawInstanced(Handle handle, GLenum mode, size_t start, size_t count, const InstanceSource & instances)
+    {
+        const Allocation & allocation = m_allocations[handle];
+        bindInstances(instances);
+        glDrawElementsInstancedBaseVertex(mode, GLsizei(count), m_index_type, (void *)((allocation.first_index + start) * indexSize()),
+                                          instances.count, GLint(allocation.first_vertex));
+    }
+
+    GLuint vertexArray() const { return m_vao; }
+    const VertexLayout & layout() const { return m_layout; }
+    GLenum indexType() const { return m_index_type; }
+    size_t indexSize() const { return m_index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+
+    private:
+    BufferArena(const BufferArena &);
+    BufferArena & operator=(const BufferArena &);
+
+    // points vao at the mesh buffers
+    void setupMeshAttributes(GLuint vao) const
+    {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        for (int i = 0; i < m_layout.count; i++)
+        {
+            const VertexAttribute & attribute = m_layout.attributes[i];
+            glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, m_layout.stride, (void*)(size_t)attribute.offset);
+            glEnableVertexAttribArray(attribute.location);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // binds the instanced VAO, created on first use, with its per-instance attributes on instances
+    void bindInstances(const InstanceSource & instances)
+    {
+        if (!m_instanced_vao)
+        {
+            glGenVertexArrays(1, &m_instanced_vao);
+            setupMeshAttributes(m_instanced_vao);
+        }
+        glBindVertexArray(m_instanced_vao);
+        if (instances.layout == m_instance_layout && instances.buffer == m_instance_buffer && instances.offset == m_instance_offset)
+            return;
+
+        const VertexLayout & layout = *instances.layout;
+        glBindBuffer(GL_ARRAY_BUFFER, instances.buffer);
+        for (int i = 0; i < layout.count; i++)
+        {
+            const VertexAttribute & attribute = layout.attributes[i];
+            glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, layout.stride,
+                                  (void*)(instances.offset + attribute.offset));
+            glEnableVertexAttribArray(attribute.location);
+            glVertexAttribDivisor(attribute.location, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_instance_layout = instances.layout;
+        m_instance_buffer = instances.buffer;
+        m_instance_offset = instances.offset;
+    }
+
+    bool reserve(Allocation & allocation)
+    {
+        if (!m_vertex_free.allocate(allocation.vertex_count, allocation.first_vertex))
+            return false;
+        if (!m_index_free.allocate(allocation.index_count, allocation.first_index))
+        {
+            m_vertex_free.free(allocation.first_vertex, allocation.vertex_count);
+            return false;
+        }
+        return true;
+    }
+
+    // moves the live meshes, packed, into new buffers of the given capacities (in elements)
+    void relocate(size_t vertex_capacity, size_t index_capacity)
+    {
+        GLuint vbo, ebo;
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+        glBufferData(GL_COPY_WRITE_BUFFER, vertex_capacity * m_layout.stride, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferData(GL_COPY_WRITE_BUFFER, index_capacity * indexSize(), NULL, GL_STATIC_DRAW);
+
+        size_t next_vertex = 0, next_index = 0;
+        for (size_t i = 0; i < m_allocations.size(); i++)
+        {
+            Allocation & allocation = m_allocations[i];
+            if (!allocation.live)
+                continue;
+            glBindBuffer(GL_COPY_READ_BUFFER, m_vbo);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.first_vertex * m_layout.stride,
+                                next_vertex * m_layout.stride, allocation.vertex_count * m_layout.stride);
+            glBindBuffer(GL_COPY_READ_BUFFER, m_ebo);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.first_index * indexSize(),
+                                next_index * indexSize(), allocation.index_count * indexSize());
+            allocation.first_vertex = next_vertex;
+            allocation.first_index = next_index;
+            next_vertex += allocation.vertex_count;
+            next_index += allocation.index_count;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &m_vbo);
+        glDeleteBuffers(1, &m_ebo);
+        m_vbo = vbo;
+        m_ebo = ebo;
+        m_vertex_capacity = vertex_capacity;
+        m_index_capacity = index_capacity;
+        m_vertex_free.reset(vertex_capacity, next_vertex);
+        m_index_free.reset(index_capacity, next_index);
+
+        // the VAOs point to the new buffers
+        setupMeshAttributes(m_vao);
+        if (m_instanced_vao)
+            setupMeshAttributes(m_instanced_vao);
+        updateMemory();
+    }
+
+    // the arena entry holds the unused capacity, the meshes account for their own ranges
+    void updateMemory()
+    {
+        m_memory.gpu_vbo = m_vertex_free.available() * m_layout.stride;
+        m_memory.gpu_ebo = m_index_free.available() * indexSize();
+    }
+
+    VertexLayout m_layout;
+    GLenum m_index_type;
+    GLuint m_vao;
+    GLuint m_vbo;
+    GLuint m_ebo;
+    size_t m_vertex_capacity;
+    size_t m_index_capacity;
+    ArenaFreeList m_vertex_free;
+    ArenaFreeList m_index_free;
+    std::vector<Allocation> m_allocations;
+    std::vector<Handle> m_free_handles;
+    MemoryStats m_memory;
+
+    // instanced draws, and the instance source their VAO points to
+    GLuint m_instanced_vao;
+    const VertexLayout * m_instance_layout;
+    GLuint m_instance_buffer;
+    size_t m_instance_offset;
+};
+
+// arenas by vertex layout and index type, created on first use
+inline std::vector<BufferArena *> & buffer_arenas()
+{
+    static std::vector<BufferArena *> arenas;
+    return arenas;
+}
+
+inline BufferArena & buffer_arena_for(const VertexLayout & layout, GLenum index_type)
+{
+    std::vector<BufferArena *> & arenas = buffer_arenas();
+    for (size_t i = 0; i < arenas.size(); i++)
+        if (arenas[i]->indexType() == index_type && vertex_layout_equal(arenas[i]->layout(), layout))
+            return *arenas[i];
+    arenas.push_back(new BufferArena(layout, index_type));
+    return *arenas.back();
+}
+
+// deletes the arenas, once every renderer is destroyed and while the context is current
+inline void buffer_arenas_release()
+{
+    std::vector<BufferArena *> & arenas = buffer_arenas();
+    for (size_t i = 0; i < arenas.size(); i++)
+        delete arenas[i];
+    arenas.clear();
+}
@@ -4,6 +4,8 @@
 
 #include <glm/glm.hpp>
 
+#include <vector>
+
 // computes the normal of a triangle given its vertices, counter-clockwise
 static glm::vec3 computeNormal(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2)
 {
@@ -12,3 +14,27 @@ static glm::vec3 computeNormal(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2)
     glm::vec3 normal = glm::normalize(glm::cross(diff1, diff2));
     return normal;
 }
+
+// per-vertex normals of flat faces: each vertex takes the normal of the last face that uses it.
+// vertices and normals: 3 floats per vertex
+inline void computeFlatNormals(const std::vector<GLfloat> & vertices, const std::vector<GLuint> & faces, std::vector<GLfloat> & normals)
+{
+    for (size_t i = 0; i + 2 < faces.size(); i += 3)
+    {
+        GLuint v0 = faces[i + 0]; // first vertex index
+        GLuint v1 = faces[i + 1]; // second vertex index
+        GLuint v2 = faces[i + 2]; // third vertex index
+
+        glm::vec3 normal = computeNormal(glm::vec3(vertices[v0 * 3 + 0], vertices[v0 * 3 + 1], vertices[v0 * 3 + 2]),
+            glm::vec3(vertices[v1 * 3 + 0], vertices[v1 * 3 + 1], vertices[v1 * 3 + 2]),
+            glm::vec3(vertices[v2 * 3 + 0], vertices[v2 * 3 + 1], vertices[v2 * 3 + 2]));
+
+        const GLuint corners[3] = { v0, v1, v2 };
+        for (int c = 0; c < 3; c++)
+        {
+            normals[corners[c] * 3 + 0] = normal.x;
+            normals[corners[c] * 3 + 1] = normal.y;
+            normals[corners[c] * 3 + 2] = normal.z;
+        }
+    }
+}
@@ -11,9 +11,9 @@
 class ConeGeometry : public IGeometry
 {
 public:
-    ConeGeometry(float radius, float height, glm::vec3 color_base, glm::vec3 color_side)
+    ConeGeometry(float radius, float height, glm::vec3 color_base, glm::vec3 color_side, int samples = 20)
     {
-        const int SAMPLES = 20;
+        const int SAMPLES = samples;
         m_vertices = new GLfloat[3 * (3 * SAMPLES + 1)];
         m_colors = new GLfloat[3 * (3 * SAMPLES + 1)];
         m_normals = new GLfloat[3 * (3 * SAMPLES + 1)];
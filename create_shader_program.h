@@ -5,6 +5,19 @@
 #include <string>
 #include <fstream>
 
+// declarations shared by every shader (the uniform blocks of shader_constants.h, helpers)
+const char * const SHADER_COMMON_FILENAME = "shader_common.glsl";
+
+// inserts common after the #version line of source; #line keeps the compile errors on the file's own lines
+static std::string withCommonSource(const std::string & source, const std::string & common)
+{
+    const size_t version = source.find("#version");
+    const size_t line_end = version == std::string::npos ? std::string::npos : source.find('\n', version);
+    if (line_end == std::string::npos)
+        return common + "\n#line 1\n" + source;
+    return source.substr(0, line_end + 1) + common + "\n#line 2\n" + source.substr(line_end + 1);
+}
+
 static GLuint createShaderProgram(const std::string vertex_filename, const std::string fragment_filename)
 {
     // find current path
@@ -26,10 +39,18 @@ static GLuint createShaderProgram(const std::string vertex_filename, const std::
         std::cout << "Could not open fragment shader file: \"" << this_path + fragment_filename << "\"" << std::endl;
     }
 
-    // files to strings
-    std::string vertexShaderSourceStr = std::string(std::istreambuf_iterator<char>(vertex_file), std::istreambuf_iterator<char>());
+    std::string compl_common_filename = this_path + SHADER_COMMON_FILENAME;
+    std::ifstream common_file(compl_common_filename.c_str());
+    if (!common_file)
+    {
+        std::cout << "Could not open shader file: \"" << compl_common_filename << "\"" << std::endl;
+    }
+
+    // files to strings, the common declarations in both stages
+    const std::string commonSourceStr = std::string(std::istreambuf_iterator<char>(common_file), std::istreambuf_iterator<char>());
+    std::string vertexShaderSourceStr = withCommonSource(std::string(std::istreambuf_iterator<char>(vertex_file), std::istreambuf_iterator<char>()), commonSourceStr);
     const char * vertexShaderSource = vertexShaderSourceStr.c_str();
-    std::string fragmentShaderSourceStr = std::string(std::istreambuf_iterator<char>(fragment_file), std::istreambuf_iterator<char>());
+    std::string fragmentShaderSourceStr = withCommonSource(std::string(std::istreambuf_iterator<char>(fragment_file), std::istreambuf_iterator<char>()), commonSourceStr);
     const char * fragmentShaderSource = fragmentShaderSourceStr.c_str();
 
     // build and compile our shader program
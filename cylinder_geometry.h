@@ -11,9 +11,9 @@
 class CylinderGeometry : public IGeometry
 {
 public:
-    CylinderGeometry(float radius, float height, glm::vec3 color_top, glm::vec3 color_bottom, glm::vec3 color_side)
+    CylinderGeometry(float radius, float height, glm::vec3 color_top, glm::vec3 color_bottom, glm::vec3 color_side, int samples = 30)
     {
-        const int SAMPLES = 30;
+        const int SAMPLES = samples;
         m_vertices = new GLfloat[3 * (4 * SAMPLES + 2)];
         m_colors = new GLfloat[3 * (4 * SAMPLES + 2)];
         m_normals = new GLfloat[3 * (4 * SAMPLES + 2)];
@@ -9,8 +9,18 @@
 #include <string>
 #include <fstream>
 #include <streambuf>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
 
 #include <vector>
+#include <cerrno>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -20,37 +30,70 @@
 #include "compute_normals.h"
 #include "load_texture.h"
 #include "assimp_geometry.h"
+#include "ply_geometry.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "asset_loader.h"
 #include "cylinder_geometry.h"
 #include "sphere_geometry.h"
 #include "init_window.h"
 #include "cone_geometry.h"
+#include "init_offscreen.h"
+#include "offscreen_framebuffer.h"
+#include "input_log.h"
+#include "profiler.h"
+#include "gpu_timer.h"
+#include "image_diff.h"
+#include "ppm_image.h"
+#include "gl_capture.h"
+#include "memory_stats.h"
+#include "render_queue.h"
+#include "bird_instances.h"
+#include "forest_instances.h"
+#include "scene_graph.h"
+#include "flock.h"
 
 unsigned int scr_width = 600;
 unsigned int scr_height = 600;
 
 int shaderProgram;
-GLint transformationUniformLocation;
-GLint modelviewUniformLocation;
-// light properties
-GLint lightPositionUniformLocation;
-GLint lightAmbientUniformLocation;
-GLint lightDiffuseUniformLocation;
-GLint lightSpecularUniformLocation;
-// material properties
-GLint shininessUniformLocation;
-GLint colorSpecularUniformLocation;
-GLint colorEmittedUniformLocation;
-GLint hasTextureUniformLocation;
-GLint stateTree;
-
-GLint colorTextureUniformLocation;
-
-ModelRenderer * tree;
-ModelRenderer * nest;
-ModelRenderer * body;
-ModelRenderer * head;
-ModelRenderer * mouth;
-ModelRenderer * wing;
+int birdProgram; // bird_instanced.vert
+int treeProgram; // tree_instanced.vert
+
+// set by the asset loader once uploaded, NULL (skipped when drawing) until then
+ModelRenderer * tree = NULL;
+ModelRenderer * nest = NULL;
+ModelRenderer * body = NULL;
+ModelRenderer * head = NULL;
+ModelRenderer * mouth = NULL;
+ModelRenderer * wing = NULL;
+
+// trees dominate the vertex fetch and the VRAM: quantized positions, packed normals, byte colors (16 bytes per vertex)
+const VertexFormat TREE_VERTEX_FORMAT = VertexFormat::compact();
+
+// time the GL thread may spend uploading loaded assets in a frame
+const double ASSET_UPLOAD_BUDGET_MS = 4.0;
+
+// every object shares the same surface for now
+const Material DEFAULT_MATERIAL = { 0, 25.0f, glm::vec3(0.7f, 0.7f, 0.7f), glm::vec3(0.0f, 0.0f, 0.0f), false };
+
+// the draws of the frame, sorted by program, vertex array, material and depth
+RenderQueue render_queue;
+
+// birds drawn, each part of all of them in one instanced draw (--birds N)
+int flock_size = 1;
+const int FLOCK_COARSE_BIRDS = 1000; // larger flocks use coarser parts: the full detail head alone is 1152 triangles
+StreamBuffer * bird_stream = NULL; // the BirdInstance array of each frame, created in main()
+InstanceSource bird_instances;
+// --boids: the flock is simulated (flock.h) instead of flying the scripted rings
+bool simulate_flock = false;
+Flock * flock = NULL;
+const double MAX_FLOCK_STEP = 1.0 / 30.0; // slow frames take a bounded step, the boids stay stable
+
+// trees drawn, all copies of the tree mesh in one instanced draw (--forest N, --forest-seed S)
+int forest_size = 1;
+unsigned int forest_seed = 1;
+Forest forest; // the TreeInstance buffer, created in main()
 
 float bird_angle = 0.0f;
 float wing_angle = 0.0f;
@@ -63,124 +106,115 @@ bool is_bird_rotating = true;
 
 glm::mat4 inputModelMatrix = glm::mat4(1.0);
 
-void load_matrices(glm::mat4 projection_matrix, glm::mat4 view_matrix, glm::mat4 model_matrix)
+// the transform hierarchy: the scene root follows inputModelMatrix, the tree (the whole forest),
+// the nest and the flock hang from it and never move on their own
+SceneGraph scene;
+int scene_root;
+int tree_node;
+int nest_node;
+int flock_node;
+
+void build_scene()
 {
-  glm::mat4 transf = projection_matrix * view_matrix * model_matrix;
-  glm::mat4 modelview = view_matrix * model_matrix;
-  glUniformMatrix4fv(transformationUniformLocation, 1, GL_FALSE, glm::value_ptr(transf));
-  glUniformMatrix4fv(modelviewUniformLocation, 1, GL_FALSE, glm::value_ptr(modelview));
+    scene_root = scene.add(SCENE_NO_PARENT, inputModelMatrix);
+    tree_node = scene.add(scene_root, glm::mat4(1.0f));
+    nest_node = scene.add(scene_root, glm::mat4(1.0f));
+    flock_node = scene.add(scene_root, glm::mat4(1.0f));
 }
 
-void display_bird(glm::mat4 projection_matrix, glm::mat4 view_matrix, glm::mat4 parent_model, GLFWwindow* window)
+// writes the flock into the instance ring and submits one instanced draw per bird part
+void display_birds(const glm::mat4 & parent_model)
 {
-    glm::mat4 bird_matrix = parent_model;
-    bird_matrix = glm::rotate(bird_matrix, bird_angle, glm::vec3(0.0f, 0.0f, 1.0f));
-    bird_matrix = glm::translate(bird_matrix, glm::vec3(-7.5f, 0.0f, 0.0f));
-
-    //mouth
-    glm::mat4 mouth_matrix = bird_matrix;
-    mouth_matrix = glm::rotate(mouth_matrix, glm::pi<float>() / 2, glm::vec3(0.0f, 1.0f, 0.0f));
-    load_matrices(projection_matrix, view_matrix, mouth_matrix);
-    mouth->render();
-
-    //head
-    glm::mat4 head_matrix = bird_matrix;
-    head_matrix = glm::translate(head_matrix, glm::vec3(-1.0f, 0.0f, 0.0f));
-    load_matrices(projection_matrix, view_matrix, head_matrix);
-    head->render();
-
-    //body
-    glm::mat4 body_matrix = bird_matrix;
-    body_matrix = glm::translate(body_matrix, glm::vec3(-3.0f, 0.0f, 0.0f));
-    body_matrix = glm::rotate(body_matrix, glm::pi<float>() / 2, glm::vec3(0.0f, 1.0f, 0.0f));
-    load_matrices(projection_matrix, view_matrix, body_matrix);
-    body->render();
-
-    //wings left
-    glm::mat4 wing_left = bird_matrix;
-    wing_left = glm::rotate(wing_left, wing_angle, glm::vec3(1.0f, 0.0f, 0.0f));
-    wing_left = glm::translate(wing_left, glm::vec3(-3.0f, 1.25f, 0.0f));
-    wing_left = glm::scale(wing_left, glm::vec3(1.0f, 1.0f, 0.3f / 2.0f));
-    load_matrices(projection_matrix, view_matrix, wing_left);
-    wing->render();
-
-    //wings right
-    glm::mat4 wing_right = bird_matrix;
-    wing_right = glm::rotate(wing_right, -wing_angle, glm::vec3(1.0f, 0.0f, 0.0f));
-    wing_right = glm::translate(wing_right, glm::vec3(-3.0f, -1.25f, 0.0f));
-    wing_right = glm::scale(wing_right, glm::vec3(1.0f, 1.0f, 0.3f / 2.0f));
-    load_matrices(projection_matrix, view_matrix, wing_right);
-    wing->render();
+    PROFILE_ZONE("display_birds");
+    const size_t bytes = size_t(flock_size) * sizeof(BirdInstance);
+    BirdInstance * birds = (BirdInstance *)bird_stream->map(bytes);
+    if (!birds)
+        return;
+    if (flock)
+        flock->write(birds);
+    else
+        write_bird_formation(birds, size_t(flock_size), bird_angle, wing_angle);
+    bird_stream->unmap(bytes);
+
+    bird_instances.layout = &bird_instance_layout();
+    bird_instances.buffer = bird_stream->buffer();
+    bird_instances.offset = bird_stream->lastOffset();
+    bird_instances.count = flock_size;
+
+    const InstanceConstants * parts = bird_parts();
+    render_queue.submitInstanced(mouth, birdProgram, &DEFAULT_MATERIAL, parent_model, &bird_instances, &parts[BIRD_MOUTH]);
+    render_queue.submitInstanced(head, birdProgram, &DEFAULT_MATERIAL, parent_model, &bird_instances, &parts[BIRD_HEAD]);
+    render_queue.submitInstanced(body, birdProgram, &DEFAULT_MATERIAL, parent_model, &bird_instances, &parts[BIRD_BODY]);
+    render_queue.submitInstanced(wing, birdProgram, &DEFAULT_MATERIAL, parent_model, &bird_instances, &parts[BIRD_WING_LEFT]);
+    render_queue.submitInstanced(wing, birdProgram, &DEFAULT_MATERIAL, parent_model, &bird_instances, &parts[BIRD_WING_RIGHT]);
 }
 
 void display(GLFWwindow* window)
 {
+    PROFILE_ZONE("display");
     // render
     // ------
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glUseProgram(shaderProgram);
-
     const float PI = std::acos(-1.0f);
-    glm::mat4 model_matrix = glm::mat4(1.0);
-    model_matrix = inputModelMatrix * model_matrix;
+    // only recomputed when the scene was rotated
+    scene.setLocal(scene_root, inputModelMatrix);
+    scene.update();
 
     glm::mat4 view_matrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -35.0f));
 
-    glm::mat4 projection_matrix = glm::perspective(glm::pi<float>() / 4.0f, float(scr_width) / float(scr_height), 1.0f, 75.0f);
+    const float near_plane = 1.0f;
+    const float far_plane = std::max(75.0f, 35.0f + forest.extent()); // the whole forest, whatever the rotation
+    glm::mat4 projection_matrix = glm::perspective(glm::pi<float>() / 4.0f, float(scr_width) / float(scr_height), near_plane, far_plane);
 
+    FrameConstants frame = FrameConstants();
+    frame.projection = projection_matrix;
+    frame.view = view_matrix;
     glm::vec3 light_position(0.56f, -0.78f, -0.29f);
-    glm::vec3 light_camera_position = glm::vec3(view_matrix * glm::vec4(light_position, 1.0f));
-    glm::vec3 light_ambient(0.2f, 0.2f, 0.2f);
-    glm::vec3 light_diffuse(0.6f, 0.6f, 0.6f);
-    glm::vec3 light_specular(0.4f, 0.4f, 0.4f);
-    glUniform3fv(lightPositionUniformLocation, 1, glm::value_ptr(light_camera_position));
-    glUniform3fv(lightAmbientUniformLocation, 1, glm::value_ptr(light_ambient));
-    glUniform3fv(lightDiffuseUniformLocation, 1, glm::value_ptr(light_diffuse));
-    glUniform3fv(lightSpecularUniformLocation, 1, glm::value_ptr(light_specular));
-
-    GLfloat shininess = 25.0f;
-    glUniform1f(shininessUniformLocation, shininess);
-    glUniform3f(colorSpecularUniformLocation, 0.7f, 0.7f, 0.7f);
-    glUniform3f(colorEmittedUniformLocation, 0.0f, 0.0f, 0.0f);
-
-    glUniform1i(colorTextureUniformLocation, 0);
-
-    glUniform1i(stateTree, state_tree);
+    frame.light_position = view_matrix * glm::vec4(light_position, 1.0f);
+    frame.light_ambient = glm::vec4(0.2f, 0.2f, 0.2f, 0.0f);
+    frame.light_diffuse = glm::vec4(0.6f, 0.6f, 0.6f, 0.0f);
+    frame.light_specular = glm::vec4(0.4f, 0.4f, 0.4f, 0.0f);
+    frame.state_tree = state_tree;
+
+    render_queue.begin(frame, near_plane, far_plane);
+    render_queue.submitInstanced(tree, treeProgram, &DEFAULT_MATERIAL, scene.world(tree_node), &forest.instances(), &forest.part());
+    render_queue.submit(nest, shaderProgram, &DEFAULT_MATERIAL, scene.world(nest_node));
+    display_birds(scene.world(flock_node));
+    render_queue.execute();
+    bird_stream->endFrame();
+}
 
-    load_matrices(projection_matrix, view_matrix, model_matrix);
-    tree->render();
+// input state, updated by the glfw callbacks or by an input log replay
+bool key_down[GLFW_KEY_LAST + 1] = { false };
+bool mouse_left_down = false;
 
-    load_matrices(projection_matrix, view_matrix, model_matrix);
-    nest->render();
+InputRecorder * input_recorder = NULL; // when set, input events are written to a log
+InputReplay * input_replay = NULL;     // when set, live input is ignored and events come from a log
+double input_start_time = 0.0;
 
-    display_bird(projection_matrix, view_matrix, model_matrix, window);
+// time step of the simulation when replaying or running headless
+const double FIXED_TIME_STEP = 1.0 / 60.0;
 
+// where the profiler zones are written (P key or exit), when built with ENABLE_PROFILER
+std::string trace_filename = "trace.json";
 
-    glfwSwapBuffers(window);
-}
+// when set, the GL calls up to the end of the first frame are written to this file (see gl_replay)
+const char * capture_filename = NULL;
 
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
-// ---------------------------------------------------------------------------------------------
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+void resize(int width, int height)
 {
     scr_width = width;
     scr_height = height;
 
     glViewport(0, 0, width, height);
-    display(window);
 }
 
-void window_refresh_callback(GLFWwindow* window)
+void handle_key(int key, int action)
 {
-    display(window);
-}
-
-void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
-{
-    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+    if (key >= 0 && key <= GLFW_KEY_LAST && action != GLFW_REPEAT)
+        key_down[key] = action == GLFW_PRESS;
 
     if (key == GLFW_KEY_W && action == GLFW_PRESS)
         are_wings_moving = !are_wings_moving;
@@ -195,18 +229,24 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         state_tree = state_tree == 0.0 ? 1.0 : 2.0;
 }
 
-void mouse_cursor_callback(GLFWwindow * window, double xpos, double ypos)
+void handle_mouse_button(int button, int action)
+{
+    if (button == GLFW_MOUSE_BUTTON_LEFT)
+        mouse_left_down = action == GLFW_PRESS;
+}
+
+void handle_cursor(float xpos, float ypos)
 {
     static float prev_x = -1.0; // position at previous iteration (-1 for none)
     static float prev_y = -1.0;
     const float SPEED = 0.005f; // rad/pixel
 
-    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS)
+    if (mouse_left_down)
     {
         if (prev_x >= 0.0f && prev_y >= 0.0f)   // if there is a previously stored position
         {
-            float xdiff = float(xpos) - prev_x; // compute diff
-            float ydiff = float(ypos) - prev_y;
+            float xdiff = xpos - prev_x; // compute diff
+            float ydiff = ypos - prev_y;
             float delta_y = SPEED * ydiff;
             float delta_x = SPEED * xdiff;
 
@@ -216,8 +256,8 @@ void mouse_cursor_callback(GLFWwindow * window, double xpos, double ypos)
             inputModelMatrix = rot * inputModelMatrix;
         }
 
-        prev_x = float(xpos); // store mouse position for next iteration
-        prev_y = float(ypos);
+        prev_x = xpos; // store mouse position for next iteration
+        prev_y = ypos;
     }
     else
     {
@@ -226,18 +266,105 @@ void mouse_cursor_callback(GLFWwindow * window, double xpos, double ypos)
     }
 }
 
-void advance(GLFWwindow* window, double time_diff)
+// applies the logged events recorded before the given session time
+void replay_input(double until)
+{
+    const InputEvent * event;
+    while ((event = input_replay->next(until)) != NULL)
+    {
+        switch (event->type)
+        {
+        case INPUT_KEY:
+            handle_key(event->a, event->b);
+            break;
+        case INPUT_MOUSE_BUTTON:
+            handle_mouse_button(event->a, event->b);
+            break;
+        case INPUT_CURSOR:
+            handle_cursor(event->x, event->y);
+            break;
+        case INPUT_RESIZE:
+            resize(event->a, event->b);
+            break;
+        }
+    }
+}
+
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+// ---------------------------------------------------------------------------------------------
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    if (input_replay)
+        return;
+    if (input_recorder)
+        input_recorder->resize(glfwGetTime() - input_start_time, width, height);
+
+    resize(width, height);
+    display(window);
+    glfwSwapBuffers(window);
+}
+
+void window_refresh_callback(GLFWwindow* window)
 {
+    display(window);
+    glfwSwapBuffers(window);
+}
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, true);
+
+    if (key == GLFW_KEY_P && action == GLFW_PRESS && profiler_dump(trace_filename))
+        std::cout << "Trace written to " << trace_filename << std::endl;
+
+    if (key == GLFW_KEY_M && action == GLFW_PRESS)
+    {
+        memory_dump(std::cout);
+        std::cout << std::endl;
+    }
+
+    if (input_replay)
+        return;
+    if (input_recorder)
+        input_recorder->key(glfwGetTime() - input_start_time, key, action);
+
+    handle_key(key, action);
+}
+
+void mouse_button_callback(GLFWwindow * window, int button, int action, int mods)
+{
+    if (input_replay)
+        return;
+    if (input_recorder)
+        input_recorder->mouseButton(glfwGetTime() - input_start_time, button, action);
+
+    handle_mouse_button(button, action);
+}
+
+void mouse_cursor_callback(GLFWwindow * window, double xpos, double ypos)
+{
+    if (input_replay)
+        return;
+    if (input_recorder)
+        input_recorder->cursor(glfwGetTime() - input_start_time, float(xpos), float(ypos));
+
+    handle_cursor(float(xpos), float(ypos));
+}
+
+void advance(double time_diff)
+{
+    PROFILE_ZONE("advance");
     float delta_x = 0.0;
     float delta_y = 0.0;
     const float speed = 0.5;
-    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
+    if (key_down[GLFW_KEY_UP])
         delta_y = -1.0;
-    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+    if (key_down[GLFW_KEY_LEFT])
         delta_x = -1.0;
-    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
+    if (key_down[GLFW_KEY_DOWN])
         delta_y = 1.0;
-    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+    if (key_down[GLFW_KEY_RIGHT])
         delta_x = 1.0;
     delta_y *= speed * float(time_diff);
     delta_x *= speed * float(time_diff);
@@ -250,6 +377,12 @@ void advance(GLFWwindow* window, double time_diff)
     const float bird_speed = 0.40f;
     const float wing_speed = 0.5f;
 
+    if (flock && is_bird_rotating)
+    {
+        flock->params().orbit_direction = float(bird_direction);
+        flock->step(float(std::min(time_diff, MAX_FLOCK_STEP)));
+    }
+
     if(is_bird_rotating)
         bird_angle += bird_speed * time_diff * bird_direction;
     if (bird_angle > 2 * glm::pi<float>())
@@ -270,12 +403,7 @@ class NestGeometry : public IGeometry
 public:
     NestGeometry()
     {
-        const int VERTICES_SIZE = 24;
-        const int FACES_SIZE = 12;
-        m_vertices_size = VERTICES_SIZE;
-        m_size = FACES_SIZE * 3;
-
-        static GLfloat avertices[] = {
+        m_vertices = {
             -0.5, -0.5, 7,
             0.5, -0.5, 7,
             0.5, 0.5, 7,
@@ -286,19 +414,8 @@ public:
             1, 1, 6,
             -1, 1, 6,
         };
-        static GLfloat acolors[] = {
-            1, 0.5, 0,
-            1, 0.5, 0,
-            1, 0.5, 0,
-            1, 0.5, 0,
-
-            1, 0.5, 0,
-            1, 0.5, 0,
-            1, 0.5, 0,
-            1, 0.5, 0,
-        };
 
-        static GLuint indices[] = {
+        m_faces = {
             0, 1, 2, //top
             0, 2, 3,
 
@@ -318,97 +435,35 @@ public:
             5, 7, 6,
         };
 
-        m_vertices = avertices;
-        m_faces = indices;
-
-        static GLfloat anormals[VERTICES_SIZE * 3];
-        m_normals = anormals;
-
-        for (int i = 0; i < FACES_SIZE; i++)
+        m_colors.resize(m_vertices.size());
+        for (size_t i = 0; i < m_colors.size(); i += 3)
         {
-            int v0 = indices[i * 3 + 0]; // i-th face, first vertex index
-            int v1 = indices[i * 3 + 1]; // i-th face, second vertex index
-            int v2 = indices[i * 3 + 2]; // i-th face, third vertex index
-
-            float x0 = avertices[v0 * 3 + 0]; // x of first vertex
-            float y0 = avertices[v0 * 3 + 1]; // y of first vertex
-            float z0 = avertices[v0 * 3 + 2]; // z of first vertex
-
-            float x1 = avertices[v1 * 3 + 0]; // x of second vertex
-            float y1 = avertices[v1 * 3 + 1]; // y of second vertex
-            float z1 = avertices[v1 * 3 + 2]; // z of second vertex
-
-            float x2 = avertices[v2 * 3 + 0]; // x of third vertex
-            float y2 = avertices[v2 * 3 + 1]; // y of third vertex
-            float z2 = avertices[v2 * 3 + 2]; // z of third vertex
-
-            glm::vec3 normal = computeNormal(glm::vec3(x0, y0, z0),
-                glm::vec3(x1, y1, z1),
-                glm::vec3(x2, y2, z2));
-
-            m_normals[v0 * 3 + 0] = normal.x; // set normal for first vertex
-            m_normals[v0 * 3 + 1] = normal.y;
-            m_normals[v0 * 3 + 2] = normal.z;
-
-            m_normals[v1 * 3 + 0] = normal.x; // set normal for second vertex
-            m_normals[v1 * 3 + 1] = normal.y;
-            m_normals[v1 * 3 + 2] = normal.z;
-
-            m_normals[v2 * 3 + 0] = normal.x; // set normal for third vertex
-            m_normals[v2 * 3 + 1] = normal.y;
-            m_normals[v2 * 3 + 2] = normal.z;
+            m_colors[i + 0] = 1;
+            m_colors[i + 1] = 0.5;
+            m_colors[i + 2] = 0;
         }
 
+        m_normals.resize(m_vertices.size());
+        computeFlatNormals(m_vertices, m_faces, m_normals);
     }
 
-    ~NestGeometry()
-    {
-    }
+    const GLfloat* vertices() { return m_vertices.data(); }
+    const GLfloat* colors() { return m_colors.data(); }
+    const GLfloat* normals() { return m_normals.data(); }
 
-    const GLfloat* vertices()
-    {
-        return m_vertices;
-    }
-    const GLfloat* colors()
-    {
-        static GLfloat acolors[] = {
-            1, 0.5, 0,
-            1, 0.5, 0,
-            1, 0.5, 0,
-            1, 0.5, 0,
-
-            1, 0.5, 0,
-            1, 0.5, 0,
-            1, 0.5, 0,
-            1, 0.5, 0,
-        };
+    GLsizei verticesSize() { return GLsizei(m_vertices.size() / 3); }
+    const GLuint* faces() { return m_faces.data(); }
 
-        return acolors;
-    }
-
-    const GLfloat* normals()
-    {
-        return m_normals;
-    }
-
-    GLsizei verticesSize() { return m_vertices_size; }
-    const GLuint* faces()
-    {
-        return m_faces;
-    }
-
-    GLsizei size() { return m_size; }
+    GLsizei size() { return GLsizei(m_faces.size()); }
 
     GLenum type() { return GL_TRIANGLES; }
 
 private:
-    GLfloat* m_vertices;
-    GLfloat* m_normals;
-
-    GLuint* m_faces;
+    std::vector<GLfloat> m_vertices;
+    std::vector<GLfloat> m_colors;
+    std::vector<GLfloat> m_normals;
 
-    GLsizei m_vertices_size;
-    GLsizei m_size;
+    std::vector<GLuint> m_faces;
 };
 
 class WingGeometry : public IGeometry
@@ -416,12 +471,7 @@ class WingGeometry : public IGeometry
 public:
     WingGeometry()
     {
-        const int VERTICES_SIZE = 24;
-        const int FACES_SIZE = 12;
-        m_vertices_size = VERTICES_SIZE;
-        m_size = FACES_SIZE * 3;
-
-        static GLfloat avertices[] = {
+        m_vertices = {
             -1.0,  -1.0,   1.0,
              1.0,  -1.0,   1.0,
              1.0,   1.0,   1.0,
@@ -453,7 +503,7 @@ public:
             -1.0,   1.0,  -1.0,
         };
 
-        static GLuint indices[] = {
+        m_faces = {
             0, 1, 2, // front
             0, 2, 3, // front
 
@@ -473,172 +523,406 @@ public:
            21,23,22, // back
         };
 
-        m_vertices = avertices;
-        m_faces = indices;
+        m_colors.assign(m_vertices.size(), 0.7f);
+
+        m_normals.resize(m_vertices.size());
+        computeFlatNormals(m_vertices, m_faces, m_normals);
+    }
 
-        static GLfloat anormals[VERTICES_SIZE * 3];
-        m_normals = anormals;
+    const GLfloat* vertices() { return m_vertices.data(); }
+    const GLfloat* colors() { return m_colors.data(); }
+    const GLfloat* normals() { return m_normals.data(); }
 
-        for (int i = 0; i < FACES_SIZE; i++)
-        {
-            int v0 = indices[i * 3 + 0]; // i-th face, first vertex index
-            int v1 = indices[i * 3 + 1]; // i-th face, second vertex index
-            int v2 = indices[i * 3 + 2]; // i-th face, third vertex index
+    GLsizei verticesSize() { return GLsizei(m_vertices.size() / 3); }
+    const GLuint* faces() { return m_faces.data(); }
 
-            float x0 = avertices[v0 * 3 + 0]; // x of first vertex
-            float y0 = avertices[v0 * 3 + 1]; // y of first vertex
-            float z0 = avertices[v0 * 3 + 2]; // z of first vertex
+    GLsizei size() { return GLsizei(m_faces.size()); }
 
-            float x1 = avertices[v1 * 3 + 0]; // x of second vertex
-            float y1 = avertices[v1 * 3 + 1]; // y of second vertex
-            float z1 = avertices[v1 * 3 + 2]; // z of second vertex
+    GLenum type() { return GL_TRIANGLES; }
 
-            float x2 = avertices[v2 * 3 + 0]; // x of third vertex
-            float y2 = avertices[v2 * 3 + 1]; // y of third vertex
-            float z2 = avertices[v2 * 3 + 2]; // z of third vertex
+private:
+    std::vector<GLfloat> m_vertices;
+    std::vector<GLfloat> m_colors;
+    std::vector<GLfloat> m_normals;
 
-            glm::vec3 normal = computeNormal(glm::vec3(x0, y0, z0),
-                glm::vec3(x1, y1, z1),
-                glm::vec3(x2, y2, z2));
+    std::vector<GLuint> m_faces;
+};
 
-            m_normals[v0 * 3 + 0] = normal.x; // set normal for first vertex
-            m_normals[v0 * 3 + 1] = normal.y;
-            m_normals[v0 * 3 + 2] = normal.z;
+// runs on a loader worker: reorders the indices and vertices for the post-transform cache,
+// overdraw and vertex fetch, then releases the source
+IGeometry * optimized(IGeometry * source)
+{
+    IGeometry * geo = new OptimizedGeometry(*source);
+    delete source;
+    return geo;
+}
 
-            m_normals[v1 * 3 + 0] = normal.x; // set normal for second vertex
-            m_normals[v1 * 3 + 1] = normal.y;
-            m_normals[v1 * 3 + 2] = normal.z;
+// display() inside a "frame" GPU zone, when a GPU timer is recording,
+// and captures it when a GL capture is in progress
+void display_timed(GLFWwindow* window, GpuTimer * gpu_timer)
+{
+    const bool capture = gl_capture_installed();
+    if (capture)
+        gl_capture_begin_frame();
 
-            m_normals[v2 * 3 + 0] = normal.x; // set normal for third vertex
-            m_normals[v2 * 3 + 1] = normal.y;
-            m_normals[v2 * 3 + 2] = normal.z;
+    if (gpu_timer)
+    {
+        gpu_timer->beginFrame();
+        {
+            GpuZone frame_zone("frame");
+            display(window);
         }
-
+        gpu_timer->endFrame();
     }
+    else
+        display(window);
 
-    ~WingGeometry()
+    if (capture)
     {
+        gl_capture_end_frame();
+        if (gl_capture_finish(capture_filename, scr_width, scr_height))
+            std::cout << "GL trace written to " << capture_filename << std::endl;
     }
+}
+
+struct HeadlessFrame
+{
+    double cpu_ms;
+    double gpu_ms;
+    std::vector<GpuTiming> draws;
+};
 
-    const GLfloat* vertices()
+static void collect_gpu_timings(const std::vector<GpuTiming> & timings, std::vector<HeadlessFrame> & frames)
+{
+    for (size_t i = 0; i < timings.size(); i++)
     {
-        return m_vertices;
+        HeadlessFrame & frame = frames[timings[i].frame];
+        if (timings[i].depth == 0)
+            frame.gpu_ms = (timings[i].end_ns - timings[i].start_ns) / 1.0e6;
+        else
+            frame.draws.push_back(timings[i]);
     }
-    const GLfloat* colors()
-    {
-        static GLfloat acolors[] = {
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-            0.7,   0.7,   0.7,
-        };
+}
 
-        return acolors;
-    }
+// headless mode: renders frames into an offscreen framebuffer with a fixed time step
+// and prints per-frame CPU (submission) and GPU times, whole frame and per draw, as JSON
+void run_headless(int frames)
+{
+    OffscreenFramebuffer framebuffer(scr_width, scr_height);
+    framebuffer.bind();
+
+    GpuTimer gpu_timer;
+    std::vector<HeadlessFrame> stats(frames);
 
-    const GLfloat* normals()
+    for (int i = 0; i < frames; i++)
+    {
+        std::chrono::steady_clock::time_point cpu_start = std::chrono::steady_clock::now();
+        display_timed(NULL, &gpu_timer);
+        stats[i].cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpu_start).count();
+        stats[i].gpu_ms = 0.0;
+        collect_gpu_timings(gpu_timer.results(), stats);
+
+        if (input_replay)
+            replay_input((i + 1) * FIXED_TIME_STEP);
+        advance(FIXED_TIME_STEP);
+    }
+    gpu_timer.finish();
+    collect_gpu_timings(gpu_timer.results(), stats);
+
+    double cpu_total = 0.0;
+    double gpu_total = 0.0;
+    std::cout << "{" << std::endl;
+    std::cout << "  \"renderer\": \"" << (const char *)glGetString(GL_RENDERER) << "\"," << std::endl;
+    std::cout << "  \"width\": " << scr_width << ", \"height\": " << scr_height << "," << std::endl;
+    std::cout << "  \"frames\": [" << std::endl;
+    for (int i = 0; i < frames; i++)
     {
-        return m_normals;
+        cpu_total += stats[i].cpu_ms;
+        gpu_total += stats[i].gpu_ms;
+        std::cout << "    {\"frame\": " << i << ", \"cpu_ms\": " << stats[i].cpu_ms << ", \"gpu_ms\": " << stats[i].gpu_ms
+                  << ", \"gpu_draws\": [";
+        for (size_t d = 0; d < stats[i].draws.size(); d++)
+            std::cout << (d ? ", " : "") << "{\"name\": \"" << stats[i].draws[d].name << "\", \"ms\": "
+                      << (stats[i].draws[d].end_ns - stats[i].draws[d].start_ns) / 1.0e6 << "}";
+        std::cout << "]}" << (i + 1 < frames ? "," : "") << std::endl;
     }
+    std::cout << "  ]," << std::endl;
+    std::cout << "  \"mean_cpu_ms\": " << (frames > 0 ? cpu_total / frames : 0.0)
+              << ", \"mean_gpu_ms\": " << (frames > 0 ? gpu_total / frames : 0.0)
+              << ", \"gpu_frames_dropped\": " << gpu_timer.dropped() << "," << std::endl;
+    std::cout << "  \"memory\": ";
+    memory_dump(std::cout, "  ");
+    std::cout << std::endl;
+    std::cout << "}" << std::endl;
+}
+
+// golden image test: fixed camera and animation states rendered offscreen and compared with reference images
+struct GoldenCase
+{
+    const char * name;
+    float rotate_x;   // scene rotation, as applied by the mouse/arrows
+    float rotate_y;
+    float bird_angle;
+    float wing_angle;
+    int state_tree;
+};
+
+const GoldenCase GOLDEN_CASES[] = {
+    { "front",        0.0f,   0.0f,  0.0f,  0.0f,  0 },
+    { "bird_wings_up", 0.0f,  0.0f,  1.57f, 0.7f,  0 },
+    { "side",        -1.57f,  0.0f,  0.8f, -0.7f,  0 },
+    { "tilted",      -1.0f,   0.6f,  2.4f,  0.3f,  0 },
+    { "tree_yellow", -1.57f,  0.0f,  0.8f,  0.0f,  1 },
+    { "tree_bare",   -1.57f,  0.0f,  0.8f,  0.0f,  2 },
+};
+
+const unsigned char GOLDEN_CHANNEL_TOLERANCE = 8; // per channel, absorbs rasterizer/driver rounding
+const double GOLDEN_MAX_MISMATCH = 0.001;         // fraction of pixels allowed to differ
+const int GOLDEN_TIMED_FRAMES = 10;
 
-    GLsizei verticesSize() { return m_vertices_size; }
-    const GLuint* faces()
+// creates directory and its missing parents; true if it exists afterwards
+bool create_directories(const std::string & directory)
+{
+    for (size_t end = directory.find_first_of("/\\", 1); ; end = directory.find_first_of("/\\", end + 1))
     {
-        return m_faces;
+        const std::string path = directory.substr(0, end);
+#ifdef _WIN32
+        const int result = _mkdir(path.c_str());
+#else
+        const int result = mkdir(path.c_str(), 0755);
+#endif
+        if (result != 0 && errno != EEXIST)
+            return false;
+        if (end == std::string::npos)
+            return true;
     }
+}
 
-    GLsizei size() { return m_size; }
+// renders every golden case into directory/<name>.ppm (update) or compares with it, and records the
+// median frame time in directory/<name>.json. a case fails if the image differs or if the frame time
+// exceeds the reference one by more than perf_tolerance (0 disables the check).
+// returns the number of failed cases.
+int run_golden(const std::string & directory, bool update, double perf_tolerance)
+{
+    OffscreenFramebuffer framebuffer(scr_width, scr_height);
+    framebuffer.bind();
 
-    GLenum type() { return GL_TRIANGLES; }
+    const size_t pixel_count = size_t(scr_width) * scr_height;
+    std::vector<unsigned char> pixels;
+    std::vector<unsigned char> reference;
+    int failures = 0;
 
-private:
-    GLfloat* m_vertices;
-    GLfloat* m_normals;
+    if (update && !create_directories(directory))
+        std::cout << "Could not create golden directory: \"" << directory << "\"" << std::endl;
 
-    GLuint* m_faces;
+    for (size_t c = 0; c < sizeof(GOLDEN_CASES) / sizeof(GOLDEN_CASES[0]); c++)
+    {
+        const GoldenCase & test = GOLDEN_CASES[c];
+        const std::string base = directory + "/" + test.name;
+
+        inputModelMatrix = glm::mat4(1.0f);
+        inputModelMatrix = glm::rotate(inputModelMatrix, test.rotate_y, glm::vec3(0.0f, 1.0f, 0.0f));
+        inputModelMatrix = glm::rotate(inputModelMatrix, test.rotate_x, glm::vec3(1.0f, 0.0f, 0.0f));
+        bird_angle = test.bird_angle;
+        wing_angle = test.wing_angle;
+        state_tree = test.state_tree;
+
+        // first frame is a warm-up (shader and buffer residency), the others are timed
+        std::vector<double> frame_times;
+        for (int f = 0; f <= GOLDEN_TIMED_FRAMES; f++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            display(NULL);
+            glFinish();
+            if (f > 0)
+                frame_times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(frame_times.begin(), frame_times.end());
+        const double frame_ms = frame_times[frame_times.size() / 2];
 
-    GLsizei m_vertices_size;
-    GLsizei m_size;
-};
+        framebuffer.readPixels(pixels);
 
-int main()
-{
-    GLFWwindow * window = init_window(scr_width, scr_height, "Test exam 10 Federico Canali");
+        if (update)
+        {
+            std::string error;
+            if (!write_ppm(base + ".ppm", pixels, scr_width, scr_height))
+                error = "could not write " + base + ".ppm";
+            FILE * stats = fopen((base + ".json").c_str(), "w");
+            bool stats_ok = stats != NULL;
+            if (stats)
+            {
+                stats_ok = fprintf(stats, "{\"frame_ms\": %f}\n", frame_ms) > 0;
+                stats_ok = fclose(stats) == 0 && stats_ok;
+            }
+            if (!stats_ok && error.empty())
+                error = "could not write " + base + ".json";
+
+            if (!error.empty())
+            {
+                failures++;
+                std::cout << "{\"case\": \"" << test.name << "\", \"updated\": false, \"error\": \"" << error << "\"}" << std::endl;
+            }
+            else
+                std::cout << "{\"case\": \"" << test.name << "\", \"updated\": true, \"frame_ms\": " << frame_ms << "}" << std::endl;
+            continue;
+        }
 
-    // callbacks
-    // ---------
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetWindowRefreshCallback(window, window_refresh_callback);
-    glfwSetKeyCallback(window, key_callback);
-    glfwSetCursorPosCallback(window, mouse_cursor_callback);
+        int width = 0, height = 0;
+        if (!read_ppm(base + ".ppm", reference, width, height) || width != int(scr_width) || height != int(scr_height))
+        {
+            std::cout << "{\"case\": \"" << test.name << "\", \"pass\": false, \"error\": \"missing reference or size mismatch, run with --golden-update\"}" << std::endl;
+            failures++;
+            continue;
+        }
 
-    AssimpGeometry tree_geo("src/p10_tree.ply");
-    ModelRenderer tree_geo_renderer(tree_geo);
-    tree = &tree_geo_renderer;
+        double reference_ms = 0.0;
+        FILE * stats = fopen((base + ".json").c_str(), "r");
+        if (stats)
+        {
+            if (fscanf(stats, " {\"frame_ms\": %lf", &reference_ms) != 1)
+                reference_ms = 0.0;
+            fclose(stats);
+        }
 
-    NestGeometry nest_geo;
-    ModelRenderer nest_geo_renderer(nest_geo);
-    nest = &nest_geo_renderer;
+        ImageDiff diff = diff_images(pixels.data(), reference.data(), pixel_count, GOLDEN_CHANNEL_TOLERANCE);
+        const bool image_ok = diff.mismatched_pixels <= GOLDEN_MAX_MISMATCH * pixel_count;
+        const bool perf_ok = perf_tolerance <= 0.0 || reference_ms <= 0.0 || frame_ms <= reference_ms * perf_tolerance;
+        if (!image_ok)
+            write_ppm(base + ".actual.ppm", pixels, scr_width, scr_height);
+        if (!image_ok || !perf_ok)
+            failures++;
+
+        std::cout << "{\"case\": \"" << test.name << "\", \"pass\": " << (image_ok && perf_ok ? "true" : "false")
+                  << ", \"mismatched_pixels\": " << diff.mismatched_pixels
+                  << ", \"max_channel_diff\": " << diff.max_channel_diff
+                  << ", \"frame_ms\": " << frame_ms << ", \"reference_frame_ms\": " << reference_ms << "}" << std::endl;
+    }
 
-    CylinderGeometry body_geo(0.5f, 3.0f, glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(1.0f));
-    ModelRenderer body_geo_renderer(body_geo);
-    body = &body_geo_renderer;
+    return failures;
+}
+
+int main(int argc, char ** argv)
+{
+    bool headless = false;
+    int frames = -1;
+    const char * record_filename = NULL;
+    const char * replay_filename = NULL;
+    const char * golden_directory = NULL;
+    bool golden_update = false;
+    double perf_tolerance = 1.5;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--headless"))
+            headless = true;
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--size") && i + 1 < argc &&
+                 sscanf(argv[++i], "%ux%u", &scr_width, &scr_height) == 2)
+            continue;
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+            record_filename = argv[++i];
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+            replay_filename = argv[++i];
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+            trace_filename = argv[++i];
+        else if (!strcmp(argv[i], "--capture") && i + 1 < argc)
+            capture_filename = argv[++i];
+        else if (!strcmp(argv[i], "--golden") && i + 1 < argc)
+            golden_directory = argv[++i];
+        else if (!strcmp(argv[i], "--golden-update"))
+            golden_update = true;
+        else if (!strcmp(argv[i], "--perf-tolerance") && i + 1 < argc)
+            perf_tolerance = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--birds") && i + 1 < argc)
+            flock_size = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--boids"))
+            simulate_flock = true;
+        else if (!strcmp(argv[i], "--forest") && i + 1 < argc)
+            forest_size = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--forest-seed") && i + 1 < argc)
+            forest_seed = unsigned(strtoul(argv[++i], NULL, 10));
+        else
+        {
+            std::cout << "usage: " << argv[0] << " [--headless] [--frames N] [--size WxH] [--record file | --replay file] [--trace file] [--capture file]"
+                      << " [--golden dir [--golden-update] [--perf-tolerance F]] [--birds N [--boids]] [--forest N [--forest-seed S]]" << std::endl;
+            return 1;
+        }
+    }
 
-    SphereGeometry head_geo(0.5f, glm::vec3(0.5f));
-    ModelRenderer head_geo_renderer(head_geo);
-    head = &head_geo_renderer;
+    if (golden_directory)
+        headless = true;
 
-    ConeGeometry mouth_geo(0.25f, 1.0f, glm::vec3(1.0f, 0.7f, 0.0f), glm::vec3(1.0f, 0.7f, 0.0f));
-    ModelRenderer mouth_geo_renderer(mouth_geo);
-    mouth = &mouth_geo_renderer;
+    GLFWwindow * window = NULL;
+    if (headless)
+        init_offscreen();
+    else
+    {
+        window = init_window(scr_width, scr_height, "Test exam 10 Federico Canali");
+
+        // callbacks
+        // ---------
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetWindowRefreshCallback(window, window_refresh_callback);
+        glfwSetKeyCallback(window, key_callback);
+        glfwSetCursorPosCallback(window, mouse_cursor_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+    }
 
-    WingGeometry wing_geo;
-    ModelRenderer wing_geo_renderer(wing_geo);
-    wing = &wing_geo_renderer;
+    // record the resource creation too, so that the captured frame can be replayed on its own
+    if (capture_filename)
+        gl_capture_install();
+
+    InputReplay * replay = replay_filename ? new InputReplay(replay_filename) : NULL;
+    InputRecorder * recorder = record_filename && !replay ? new InputRecorder(record_filename) : NULL;
+    input_replay = replay;
+    input_recorder = recorder;
+
+    // headless runs the whole replay by default
+    if (frames < 0)
+        frames = replay ? int(replay->duration() / FIXED_TIME_STEP) + 1 : 100;
+
+    build_scene();
+
+    // geometries are built on worker threads and uploaded as they are ready,
+    // the window renders from the first frame and the scene fills in
+    AssetLoader * loader = new AssetLoader();
+    loader->load([]() -> IGeometry * { return optimized(new MeshCacheGeometry("src/p10_tree.ply")); }, &tree, "tree", TREE_VERTEX_FORMAT);
+    // the forest is generated by a loader worker on the parallel_for pool, next to the meshes, and drawn once uploaded
+    loader->loadData([]() { forest.generate(size_t(forest_size), forest_seed); }, []() { forest.upload(); });
+    loader->load([]() -> IGeometry * { return optimized(new NestGeometry()); }, &nest, "nest");
+    const bool coarse_birds = flock_size > FLOCK_COARSE_BIRDS;
+    loader->load([coarse_birds]() -> IGeometry * {
+        return optimized(new CylinderGeometry(0.5f, 3.0f, glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(1.0f), coarse_birds ? 8 : 30));
+    }, &body, "body");
+    loader->load([coarse_birds]() -> IGeometry * {
+        return optimized(new SphereGeometry(0.5f, glm::vec3(0.5f), coarse_birds ? 8 : 24, coarse_birds ? 8 : 24));
+    }, &head, "head");
+    loader->load([coarse_birds]() -> IGeometry * {
+        return optimized(new ConeGeometry(0.25f, 1.0f, glm::vec3(1.0f, 0.7f, 0.0f), glm::vec3(1.0f, 0.7f, 0.0f), coarse_birds ? 8 : 20));
+    }, &mouth, "mouth");
+    loader->load([]() -> IGeometry * { return optimized(new WingGeometry()); }, &wing, "wing");
 
     // load GLSL shaders
     shaderProgram = createShaderProgram("esame_10.vert", "esame_10.frag");
-    transformationUniformLocation = glGetUniformLocation(shaderProgram, "transformation");
-    modelviewUniformLocation = glGetUniformLocation(shaderProgram, "modelview");
- 
-    lightPositionUniformLocation = glGetUniformLocation(shaderProgram, "light_position");
-    lightAmbientUniformLocation = glGetUniformLocation(shaderProgram, "light_ambient");
-    lightDiffuseUniformLocation = glGetUniformLocation(shaderProgram, "light_diffuse");
-    lightSpecularUniformLocation = glGetUniformLocation(shaderProgram, "light_specular");
 
-    shininessUniformLocation = glGetUniformLocation(shaderProgram, "shininess");
-    colorSpecularUniformLocation = glGetUniformLocation(shaderProgram, "color_specular");
-    colorEmittedUniformLocation = glGetUniformLocation(shaderProgram, "color_emitted");
+    birdProgram = createShaderProgram("bird_instanced.vert", "esame_10.frag");
 
-    colorTextureUniformLocation = glGetUniformLocation(shaderProgram, "color_texture");
+    treeProgram = createShaderProgram("tree_instanced.vert", "esame_10.frag");
 
-    hasTextureUniformLocation = glGetUniformLocation(shaderProgram, "has_texture");
-    stateTree = glGetUniformLocation(shaderProgram, "state_tree");
+    // the other constants come from the uniform blocks bound by the render queue
+    glUseProgram(shaderProgram);
+    glUniform1i(glGetUniformLocation(shaderProgram, "color_texture"), 0);
+    glUseProgram(birdProgram);
+    glUniform1i(glGetUniformLocation(birdProgram, "color_texture"), 0);
+    glUseProgram(treeProgram);
+    glUniform1i(glGetUniformLocation(treeProgram, "color_texture"), 0);
+
+    // persistent writes would bypass the capture, which records mapped ranges at unmap
+    const StreamMode stream_mode = capture_filename ? STREAM_ORPHAN : STREAM_AUTO;
+    render_queue.setUniformMode(stream_mode);
+    bird_stream = new StreamBuffer(size_t(flock_size) * sizeof(BirdInstance), stream_mode);
+    if (simulate_flock)
+        flock = new Flock(size_t(flock_size));
 
     // uncomment this call to draw in wireframe polygons.
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -650,20 +934,86 @@ int main()
     // enable depth test
     glEnable(GL_DEPTH_TEST);
 
+    // offscreen runs measure or compare complete frames, captures need every resource,
+    // replays must render the same frames whatever the load timing
+    if (headless || capture_filename || replay)
+        loader->finish();
+
+    if (golden_directory)
+    {
+        const int failures = run_golden(golden_directory, golden_update, perf_tolerance);
+        delete loader;
+        buffer_arenas_release();
+        render_queue.release();
+        delete bird_stream;
+        delete flock;
+        forest.release();
+        return failures == 0 ? 0 : 1;
+    }
+
+    if (headless)
+    {
+        run_headless(frames);
+        profiler_dump(trace_filename);
+        delete loader;
+        buffer_arenas_release();
+        render_queue.release();
+        delete bird_stream;
+        delete flock;
+        forest.release();
+        delete replay;
+        return 0;
+    }
+
     // render loop
     // -----------
     double curr_time = glfwGetTime();
     double prev_time;
+    double replay_time = 0.0;
+    input_start_time = curr_time;
+#ifdef ENABLE_PROFILER
+    GpuTimer profiler_gpu_timer; // GPU zones go to the trace, next to the CPU zones
+    GpuTimer * gpu_timer = &profiler_gpu_timer;
+#else
+    GpuTimer * gpu_timer = NULL;
+#endif
     while (!glfwWindowShouldClose(window))
     {
-        display(window);
-        glfwWaitEventsTimeout(0.01);
+        loader->update(ASSET_UPLOAD_BUDGET_MS);
+        display_timed(window, gpu_timer);
+        {
+            PROFILE_ZONE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
+        {
+            PROFILE_ZONE("glfwWaitEventsTimeout");
+            glfwWaitEventsTimeout(0.01);
+        }
+
+        if (input_replay)
+        {
+            // fixed time step: every replay of the same log renders the same frames
+            replay_time += FIXED_TIME_STEP;
+            replay_input(replay_time);
+            advance(FIXED_TIME_STEP);
+            continue;
+        }
 
         prev_time = curr_time;
         curr_time = glfwGetTime();
-        advance(window, curr_time - prev_time);
+        advance(curr_time - prev_time);
     }
 
+    profiler_dump(trace_filename);
+    delete loader; // the renderers and their arenas need the context
+    buffer_arenas_release();
+    render_queue.release();
+    delete bird_stream;
+    delete flock;
+    forest.release();
+    delete recorder;
+    delete replay;
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -1,21 +1,12 @@
 #version 330 core
-uniform vec3 light_position;
-uniform vec3 light_ambient;
-uniform vec3 light_diffuse;
-uniform vec3 light_specular;
-
-uniform float shininess;
-uniform vec3 color_specular;
-uniform vec3 color_emitted;
-
+// the uniform blocks come from shader_common.glsl
 uniform sampler2D color_texture;
-uniform bool has_texture;
-uniform int state_tree;
 
 in vec2 vTexCoords;
 in vec3 vNormal;
 in vec3 vPosition;
 in vec3 vColor;
+in vec3 vTint; // canopy color factor of the forest trees, 1 elsewhere
 
 out vec4 FragColor;
 
@@ -31,20 +22,22 @@ void main()
       color = vec3(1, 1, 0);
    else if(color.g > 0.9 && state_tree == 2)
      discard;
+   else if(color.g > 0.9)
+     color *= vTint;
 	 
-   vec3 relative_light_pos = light_position - vPosition;
+   vec3 relative_light_pos = light_position.xyz - vPosition;
    vec3 normal = normalize(vNormal);
    
-   vec3 ambient = color * light_ambient;
+   vec3 ambient = color * light_ambient.rgb;
    
    float diffuse_intensity = max(0.0, dot(normalize(relative_light_pos), normal));
-   vec3 diffuse = diffuse_intensity * color * light_diffuse;
+   vec3 diffuse = diffuse_intensity * color * light_diffuse.rgb;
    
    vec3 reflection = reflect(normalize(-relative_light_pos), normal);
    float specular_intensity = pow(max(0.0, dot(reflection, normalize(-vPosition))), shininess);
-   vec3 specular = specular_intensity * color_specular * light_specular;
+   vec3 specular = specular_intensity * color_specular.rgb * light_specular.rgb;
    
-   vec3 emitted = color_emitted;
+   vec3 emitted = color_emitted.rgb;
    
    FragColor = vec4(clamp(ambient + diffuse + specular + emitted, 0.0, 1.0), 1.0);
 }
@@ -3,25 +3,25 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec3 aNormal;
 layout (location = 3) in vec2 aTexCoords;
-
-uniform mat4 transformation;
-uniform mat4 modelview;
-
-uniform bool has_texture;
+// the uniform blocks and decode_octahedral() come from shader_common.glsl
 
 out vec2 vTexCoords;
 out vec3 vNormal;
 out vec3 vPosition;
 out vec3 vColor;
+out vec3 vTint;
+
 void main()
 {
-   gl_Position = transformation * vec4(aPos, 1.0);
-   vec4 position = modelview * vec4(aPos, 1.0);
+   vec3 pos = aPos * position_scale.xyz + position_offset.xyz;
+   vec3 normal = octahedral_normal ? decode_octahedral(aNormal.xy) : aNormal;
+   gl_Position = transformation * vec4(pos, 1.0);
+   vec4 position = modelview * vec4(pos, 1.0);
    vPosition = position.xyz / position.w;
-   mat3 normal_matrix = transpose(inverse(mat3(modelview)));
-   vNormal = normal_matrix * aNormal;
+   vNormal = normal_matrix * normal;
    if (has_texture)
      vTexCoords = aTexCoords;
    else
      vColor = aColor;
+   vTint = vec3(1.0); // only the forest trees are tinted
 }
\ No newline at end of file
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bird_instances.h"
+#include "forest_instances.h"
+#include "parallel_for.h"
+#include "profiler.h"
+
+// boids around the tree: separation, alignment and cohesion with the neighbours, plus an orbit
+// about the z axis (the trunk) inside a band of radii and heights, and a push away from the trunk
+// and canopy. positions are in the flock space of display_birds(), the tree at the origin.
+//
+// each step rebuilds a uniform spatial hash grid (cells twice the neighbour radius, hashed into a
+// table of about one bucket per bird) with a parallel counting sort: every partition of the birds counts
+// its buckets, a prefix sum gives each partition its own range inside each bucket, then every
+// partition scatters its birds. the buckets hold the birds in index order whatever the number of
+// partitions, so the simulation is deterministic. the forces then run in parallel in bucket order,
+// reading the sorted copies and writing the next state of each bird. a bird only scans the 2x2x2
+// cells on its side of its own cell: with cells 2 * neighbour_radius wide, its neighbourhood never
+// reaches past them.
+
+struct FlockParams
+{
+    float neighbour_radius = 4.0f;   // alignment and cohesion, half the grid cell size
+    float separation_radius = 2.0f;
+    int max_neighbours = 16;         // bounds the work per bird in dense spots
+
+    float separation_weight = 6.0f;
+    float alignment_weight = 1.0f;
+    float cohesion_weight = 0.5f;
+    float orbit_weight = 1.5f;       // pull toward the orbit velocity
+    float bounds_weight = 2.0f;      // back into the band of radii and heights
+    float trunk_weight = 20.0f;
+
+    float min_speed = 2.0f;
+    float max_speed = 6.0f;
+    float orbit_speed = 4.0f;
+    float orbit_direction = 1.0f;    // +1 counterclockwise about z, -1 clockwise
+
+    float inner_radius = 7.5f;       // the band the birds orbit in, the outer radius grows with the flock
+    float min_height = -4.0f;
+    float max_height = 14.0f;
+    float density = 0.02f;           // birds per unit^3 the band is sized for
+    float trunk_clearance = 1.5f;    // around FOREST_TREE_RADIUS, below the canopy top
+
+    float wing_speed = 6.0f;         // wing beats, radians of triangle wave per second
+};
+
+class Flock
+{
+    public:
+    // count birds spread over the band, from seed
+    Flock(size_t count, uint32_t seed = 1, const FlockParams & params = FlockParams())
+        : m_params(params), m_count(count), m_time(0.0f)
+    {
+        const float band_height = m_params.max_height - m_params.min_height;
+        m_outer_radius = std::max(20.0f, std::sqrt(float(count) / (m_params.density * glm::pi<float>() * band_height) +
+                                                   m_params.inner_radius * m_params.inner_radius));
+
+        m_position.resize(count);
+        m_velocity.resize(count);
+        m_next_position.resize(count);
+        m_next_velocity.resize(count);
+        m_sorted_position.resize(count);
+        m_sorted_velocity.resize(count);
+        m_sorted_index.resize(count);
+        m_bucket.resize(count);
+        m_shape.resize(count);
+
+        size_t table = 1;
+        while (table < count)
+            table <<= 1;
+        m_table_mask = uint32_t(table - 1);
+        m_bucket_start.resize(table + 1);
+
+        // one partition per thread of the parallel_for pool, which runs every pass of step()
+        m_partitions = std::max<size_t>(1, std::min<size_t>(parallel_for_threads(), (count + FLOCK_GRAIN - 1) / FLOCK_GRAIN));
+        m_counts.resize(m_partitions * table);
+
+        const float two_pi = 2.0f * glm::pi<float>();
+        const float inner = m_params.inner_radius, outer = m_outer_radius;
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint32_t index = uint32_t(i);
+            // uniform over the annulus area
+            const float radius = std::sqrt(inner * inner + (outer * outer - inner * inner) * forest_random(seed, index, 0));
+            const float angle = two_pi * forest_random(seed, index, 1);
+            const float height = m_params.min_height + band_height * forest_random(seed, index, 2);
+            const glm::vec3 radial(std::cos(angle), std::sin(angle), 0.0f);
+            const glm::vec3 tangent = m_params.orbit_direction * glm::vec3(-radial.y, radial.x, 0.0f);
+            m_position[i] = glm::vec4(radius * radial + glm::vec3(0.0f, 0.0f, height), 0.0f);
+            m_velocity[i] = glm::vec4(m_params.orbit_speed * tangent, 0.0f);
+            // x: scale, y: wing phase
+            m_shape[i] = glm::vec2(0.8f + 0.4f * forest_random(seed, index, 3), forest_random(seed, index, 4));
+        }
+    }
+
+    size_t size() const { return m_count; }
+    FlockParams & params() { return m_params; }
+    float outerRadius() const { return m_outer_radius; }
+    glm::vec3 position(size_t i) const { return glm::vec3(m_position[i]); }
+    glm::vec3 velocity(size_t i) const { return glm::vec3(m_velocity[i]); }
+
+    // advances the flock by dt seconds
+    void step(float dt)
+    {
+        PROFILE_ZONE("Flock::step");
+        buildGrid();
+        {
+            PROFILE_ZONE("Flock::forces");
+            parallel_for(m_count, [this, dt](size_t s) { updateBird<false>(s, dt); }, FLOCK_GRAIN);
+        }
+        m_position.swap(m_next_position);
+        m_velocity.swap(m_next_velocity);
+        m_time += dt;
+    }
+
+    // step() with an O(n^2) neighbour search instead of the grid, to check the grid against.
+    // with max_neighbours at least the flock size both find the same neighbours
+    void stepBruteForce(float dt)
+    {
+        PROFILE_ZONE("Flock::stepBruteForce");
+        buildGrid();
+        parallel_for(m_count, [this, dt](size_t s) { updateBird<true>(s, dt); }, FLOCK_GRAIN);
+        m_position.swap(m_next_position);
+        m_velocity.swap(m_next_velocity);
+        m_time += dt;
+    }
+
+    // the birds as instances of bird_instanced.vert: heading and pitch follow the velocity
+    void write(BirdInstance * birds) const
+    {
+        PROFILE_ZONE("Flock::write");
+        const float max_wing = glm::pi<float>() / 4.0f;
+        parallel_for(m_count, [this, birds, max_wing](size_t i) {
+            const glm::vec3 v(m_velocity[i]);
+            const float heading = std::atan2(v.y, v.x);
+            // a positive pitch (rotation about y) turns the nose (+x) down
+            const float pitch = -std::atan2(v.z, std::sqrt(v.x * v.x + v.y * v.y));
+            // triangle wave in [-max_wing, max_wing] like write_bird_formation()
+            const float t = std::fmod(m_params.wing_speed * m_time + 4.0f * max_wing * m_shape[i].y, 4.0f * max_wing);
+            const float wing = t < 2.0f * max_wing ? t - max_wing : 3.0f * max_wing - t;
+
+            BirdInstance bird;
+            bird.position = glm::vec4(glm::vec3(m_position[i]), heading);
+            bird.motion = glm::vec4(wing, pitch, m_shape[i].x, 0.0f);
+            birds[i] = bird;
+        }, FLOCK_GRAIN);
+    }
+
+    private:
+    static const size_t FLOCK_GRAIN = 4096;
+
+    uint32_t bucketOf(int x, int y, int z) const
+    {
+        return (uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u) & m_table_mask;
+    }
+
+    struct Cell
+    {
+        int x, y, z;
+    };
+
+    Cell cellOf(const glm::vec4 & p) const
+    {
+        const float inverse_cell = 0.5f / m_params.neighbour_radius;
+        const Cell cell = { int(std::floor(p.x * inverse_cell)), int(std::floor(p.y * inverse_cell)), int(std::floor(p.z * inverse_cell)) };
+        return cell;
+    }
+
+    // parallel counting sort of the birds by bucket
+    void buildGrid()
+    {
+        PROFILE_ZONE("Flock::buildGrid");
+        const size_t table = size_t(m_table_mask) + 1;
+        const size_t per_partition = (m_count + m_partitions - 1) / m_partitions;
+
+        // counts of each partition
+        parallel_for(m_partitions, [this, table, per_partition](size_t p) {
+            uint32_t * counts = &m_counts[p * table];
+            std::fill(counts, counts + table, 0u);
+            const size_t end = std::min(m_count, (p + 1) * per_partition);
+            for (size_t i = p * per_partition; i < end; i++)
+            {
+                const Cell cell = cellOf(m_position[i]);
+                const uint32_t bucket = bucketOf(cell.x, cell.y, cell.z);
+                m_bucket[i] = bucket;
+                counts[bucket]++;
+            }
+        });
+
+        // exclusive prefix sum in (bucket, partition) order: the totals of bucket ranges, their scan,
+        // then each range turns its counts into the scatter offsets of each partition
+        const size_t ranges = m_partitions;
+        const size_t per_range = (table + ranges - 1) / ranges;
+        std::vector<size_t> range_start(ranges + 1, 0);
+        parallel_for(ranges, [&](size_t r) {
+            size_t total = 0;
+            const size_t end = std::min(table, (r + 1) * per_range);
+            for (size_t b = r * per_range; b < end; b++)
+                for (size_t p = 0; p < m_partitions; p++)
+                    total += m_counts[p * table + b];
+            range_start[r + 1] = total;
+        });
+        for (size_t r = 0; r < ranges; r++)
+            range_start[r + 1] += range_start[r];
+        parallel_for(ranges, [&](size_t r) {
+            uint32_t offset = uint32_t(range_start[r]);
+            const size_t end = std::min(table, (r + 1) * per_range);
+            for (size_t b = r * per_range; b < end; b++)
+            {
+                m_bucket_start[b] = offset;
+                for (size_t p = 0; p < m_partitions; p++)
+                {
+                    const uint32_t count = m_counts[p * table + b];
+                    m_counts[p * table + b] = offset;
+                    offset += count;
+                }
+            }
+        });
+        m_bucket_start[table] = uint32_t(m_count);
+
+        // scatter, each partition into its own slots
+        parallel_for(m_partitions, [this, table, per_partition](size_t p) {
+            uint32_t * offsets = &m_counts[p * table];
+            const size_t end = std::min(m_count, (p + 1) * per_partition);
+            for (size_t i = p * per_partition; i < end; i++)
+            {
+                const uint32_t s = offsets[m_bucket[i]]++;
+                m_sorted_position[s] = m_position[i];
+                m_sorted_velocity[s] = m_velocity[i];
+                m_sorted_index[s] = uint32_t(i);
+            }
+        });
+    }
+
+    // the s-th bird in bucket order; BruteForce scans every bird instead of the grid
+    template <bool BruteForce>
+    void updateBird(size_t s, float dt)
+    {
+        const FlockParams & k = m_params;
+        const glm::vec3 p(m_sorted_position[s]);
+        const glm::vec3 v(m_sorted_velocity[s]);
+        // cells are 2 * neighbour_radius wide: a neighbour is at most half a cell away along each axis,
+        // so it is in the 2x2x2 cells on the bird's side of its cell, its own included
+        const Cell cell = cellOf(m_sorted_position[s]);
+        const float inverse_cell = 0.5f / k.neighbour_radius;
+        const int side_x = p.x * inverse_cell - float(cell.x) < 0.5f ? -1 : 1;
+        const int side_y = p.y * inverse_cell - float(cell.y) < 0.5f ? -1 : 1;
+        const int side_z = p.z * inverse_cell - float(cell.z) < 0.5f ? -1 : 1;
+        const float neighbour_radius2 = k.neighbour_radius * k.neighbour_radius;
+        const float separation_radius2 = k.separation_radius * k.separation_radius;
+
+        glm::vec3 separation(0.0f), velocity_sum(0.0f), position_sum(0.0f);
+        int neighbours = 0;
+        auto visit = [&](uint32_t begin, uint32_t end) {
+            for (uint32_t o = begin; o < end && neighbours < k.max_neighbours; o++)
+            {
+                if (o == s)
+                    continue;
+                const glm::vec3 offset = glm::vec3(m_sorted_position[o]) - p;
+                const float distance2 = glm::dot(offset, offset);
+                if (distance2 >= neighbour_radius2)
+                    continue;
+                if (distance2 < separation_radius2)
+                    separation -= offset / std::max(distance2, 1e-4f);
+                velocity_sum += glm::vec3(m_sorted_velocity[o]);
+                position_sum += offset;
+                neighbours++;
+            }
+        };
+
+        if (BruteForce)
+            visit(0, uint32_t(m_count));
+        else
+        {
+            // a bucket once even when several cells hash to it
+            uint32_t visited[8];
+            int visited_count = 0;
+            for (int dz = 0; dz < 2 && neighbours < k.max_neighbours; dz++)
+                for (int dy = 0; dy < 2 && neighbours < k.max_neighbours; dy++)
+                    for (int dx = 0; dx < 2 && neighbours < k.max_neighbours; dx++)
+                    {
+                        const uint32_t bucket = bucketOf(cell.x + dx * side_x, cell.y + dy * side_y, cell.z + dz * side_z);
+                        if (std::find(visited, visited + visited_count, bucket) != visited + visited_count)
+                            continue;
+                        visited[visited_count++] = bucket;
+                        visit(m_bucket_start[bucket], m_bucket_start[bucket + 1]);
+                    }
+        }
+
+        glm::vec3 acceleration = k.separation_weight * separation;
+        if (neighbours > 0)
+        {
+            const float inverse = 1.0f / float(neighbours);
+            acceleration += k.alignment_weight * (velocity_sum * inverse - v);
+            acceleration += k.cohesion_weight * (position_sum * inverse);
+        }
+
+        // orbit about the trunk, back into the band when out of it
+        const float radius = std::sqrt(p.x * p.x + p.y * p.y);
+        const glm::vec3 radial = radius > 1e-4f ? glm::vec3(p.x, p.y, 0.0f) / radius : glm::vec3(1.0f, 0.0f, 0.0f);
+        const glm::vec3 tangent = k.orbit_direction * glm::vec3(-radial.y, radial.x, 0.0f);
+        acceleration += k.orbit_weight * (k.orbit_speed * tangent - v);
+        if (radius < k.inner_radius)
+            acceleration += k.bounds_weight * (k.inner_radius - radius) * radial;
+        else if (radius > m_outer_radius)
+            acceleration -= k.bounds_weight * (radius - m_outer_radius) * radial;
+        if (p.z < k.min_height)
+            acceleration.z += k.bounds_weight * (k.min_height - p.z);
+        else if (p.z > k.max_height)
+            acceleration.z -= k.bounds_weight * (p.z - k.max_height);
+
+        // trunk and canopy: a cylinder up to the top of the tree, the push grows as the bird gets closer
+        const float clearance = FOREST_TREE_RADIUS + k.trunk_clearance;
+        if (radius < clearance && p.z < FOREST_CANOPY_TOP + k.trunk_clearance)
+            acceleration += k.trunk_weight * (clearance - radius) / clearance * radial;
+
+        glm::vec3 next_velocity = v + acceleration * dt;
+        const float speed = glm::length(next_velocity);
+        if (speed > k.max_speed)
+            next_velocity *= k.max_speed / speed;
+        else if (speed < k.min_speed)
+            next_velocity = speed > 1e-4f ? next_velocity * (k.min_speed / speed) : k.min_speed * tangent;
+
+        const uint32_t i = m_sorted_index[s];
+        m_next_velocity[i] = glm::vec4(next_velocity, 0.0f);
+        m_next_position[i] = glm::vec4(p + next_velocity * dt, 0.0f);
+    }
+
+    FlockParams m_params;
+    size_t m_count;
+    float m_time;
+    float m_outer_radius;
+
+    std::vector<glm::vec4> m_position; // by bird
+    std::vector<glm::vec4> m_velocity;
+    std::vector<glm::vec4> m_next_position;
+    std::vector<glm::vec4> m_next_velocity;
+    std::vector<glm::vec2> m_shape;    // x: scale, y: wing phase
+
+    // the grid
+    uint32_t m_table_mask;
+    size_t m_partitions;
+    std::vector<uint32_t> m_bucket;        // by bird
+    std::vector<uint32_t> m_counts;        // partition-major: counts, then scatter offsets
+    std::vector<uint32_t> m_bucket_start;  // table + 1 entries, into the sorted arrays
+    std::vector<glm::vec4> m_sorted_position;
+    std::vector<glm::vec4> m_sorted_velocity;
+    std::vector<uint32_t> m_sorted_index;
+};
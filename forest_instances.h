@@ -0,0 +1,163 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "buffer_arena.h"
+#include "parallel_for.h"
+#include "profiler.h"
+#include "shader_constants.h"
+#include "vertex_layout.h"
+
+// instanced forest: copies of the tree mesh, each one a TreeInstance in a static instance buffer,
+// all drawn by one instanced draw with tree_instanced.vert. the instances are generated once from
+// a seed, off the GL thread; tree i only depends on (seed, i), so the forest is the same whatever
+// the number of threads.
+
+// one tree, locations 4 and 5 of tree_instanced.vert
+struct TreeInstance
+{
+    glm::vec4 position; // xyz: where the mesh origin goes, w: rotation about z (radians)
+    glm::vec4 tint;     // rgb: canopy color factor, w: scale
+};
+
+inline const VertexLayout & tree_instance_layout()
+{
+    static const VertexLayout layout = { GLsizei(sizeof(TreeInstance)), 2, {
+        { 4, 4, GL_FLOAT, GL_FALSE, 0 },
+        { 5, 4, GL_FLOAT, GL_FALSE, GLsizei(4 * sizeof(GLfloat)) },
+    } };
+    return layout;
+}
+
+// p10_tree.ply: trunk and canopy within FOREST_TREE_RADIUS of the z axis and below FOREST_CANOPY_TOP, ground quad at FOREST_GROUND_Z
+const float FOREST_TREE_RADIUS = 3.75f;
+const float FOREST_CANOPY_TOP = 6.25f;
+const float FOREST_GROUND_Z = -7.5f;
+const float FOREST_GROUND_HALF_SIZE = 25.0f;
+// trees sit on a sunflower spiral of this density: about one tree per pi * FOREST_SPACING^2
+const float FOREST_SPACING = 5.5f;
+const float FOREST_CLEARING = 3.0f; // spiral steps skipped around the first tree, which the birds circle
+
+// 32 bit mix of the seed and the tree index (murmur3 finalizer)
+inline uint32_t forest_hash(uint32_t seed, uint32_t i)
+{
+    uint32_t h = seed ^ (i * 0x9e3779b9u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// uniform in [0, 1), the n-th draw of tree i
+inline float forest_random(uint32_t seed, uint32_t i, uint32_t n)
+{
+    return float(forest_hash(seed + n * 0x632be5abu, i) >> 8) / 16777216.0f;
+}
+
+// distance from the first tree beyond which a forest of count trees holds no tree
+inline float forest_radius(size_t count)
+{
+    if (count <= 1)
+        return 0.0f;
+    return FOREST_SPACING * (std::sqrt(float(count - 1) + FOREST_CLEARING) + 1.0f);
+}
+
+// tree 0 is the original tree: at the origin, unrotated, scale 1, untinted. the others get a jittered
+// spiral position, a rotation, a scale and a canopy tint, and stand on the same ground plane.
+inline void write_forest(TreeInstance * trees, size_t count, uint32_t seed)
+{
+    const float two_pi = 2.0f * glm::pi<float>();
+    const float golden_angle = glm::pi<float>() * (3.0f - std::sqrt(5.0f));
+    parallel_for(count, [=](size_t index) {
+        TreeInstance tree;
+        if (index == 0)
+        {
+            tree.position = glm::vec4(0.0f);
+            tree.tint = glm::vec4(1.0f);
+            trees[0] = tree;
+            return;
+        }
+        const uint32_t i = uint32_t(index);
+        const float radius = FOREST_SPACING * (std::sqrt(float(index) + FOREST_CLEARING) + 0.6f * (forest_random(seed, i, 0) - 0.5f));
+        const float angle = golden_angle * float(index) + 0.3f * (forest_random(seed, i, 1) - 0.5f);
+        const float rotation = two_pi * forest_random(seed, i, 2);
+        const float scale = 0.7f + 0.6f * forest_random(seed, i, 3);
+
+        // scaled about the base of the trunk, so the ground quads stay coplanar
+        tree.position = glm::vec4(radius * std::cos(angle), radius * std::sin(angle), FOREST_GROUND_Z * (1.0f - scale), rotation);
+        tree.tint = glm::vec4(0.6f + 0.4f * forest_random(seed, i, 4), 0.75f + 0.25f * forest_random(seed, i, 5),
+                              0.4f + 0.6f * forest_random(seed, i, 6), scale);
+        trees[index] = tree;
+    }, 4096);
+}
+
+// the forest of the scene: its static instance buffer and the Instance block of the tree mesh
+class Forest
+{
+    public:
+    Forest() : m_buffer(0), m_instances(), m_radius(0.0f), m_part()
+    {
+        m_part.part = glm::mat4(1.0f);
+        for (int c = 0; c < 3; c++)
+            m_part.part_normal_matrix[c] = glm::vec4(glm::mat3(1.0f)[c], 0.0f);
+    }
+
+    // generates count trees from seed into memory; any thread, no GL
+    void generate(size_t count, uint32_t seed)
+    {
+        PROFILE_ZONE("Forest::generate");
+        m_trees.resize(count);
+        write_forest(m_trees.data(), count, seed);
+    }
+
+    // uploads the generated trees, which are drawn from then on; needs the GL context
+    void upload()
+    {
+        PROFILE_ZONE("Forest::upload");
+        release();
+        glGenBuffers(1, &m_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glBufferData(GL_ARRAY_BUFFER, m_trees.size() * sizeof(TreeInstance), m_trees.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        m_instances.layout = &tree_instance_layout();
+        m_instances.buffer = m_buffer;
+        m_instances.offset = 0;
+        m_instances.count = GLsizei(m_trees.size());
+        m_radius = forest_radius(m_trees.size());
+        std::vector<TreeInstance>().swap(m_trees);
+    }
+
+    // GL thread, while the context is current
+    void release()
+    {
+        if (m_buffer)
+            glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+        m_instances = InstanceSource();
+        m_radius = 0.0f;
+    }
+
+    const InstanceSource & instances() const { return m_instances; }
+    // the tree mesh is the whole instance
+    const InstanceConstants & part() const { return m_part; }
+    // extent of the forest around the origin, ground included
+    float extent() const { return m_radius + FOREST_GROUND_HALF_SIZE * std::sqrt(2.0f); }
+
+    private:
+    GLuint m_buffer;
+    InstanceSource m_instances;
+    float m_radius;
+    InstanceConstants m_part;
+    std::vector<TreeInstance> m_trees; // generated, not uploaded yet
+};
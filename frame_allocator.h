@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// linear allocator for data that lives one frame (draw packets, sort keys): allocations are
+// bumps of a pointer, nothing is freed individually, reset() drops everything at once.
+// when a frame needs more than one block, the next reset() replaces the blocks with a single one
+// of the total size, so a steady scene stops allocating after its first frames.
+// only for trivially destructible types: no destructor is ever called.
+class FrameAllocator
+{
+    public:
+    explicit FrameAllocator(size_t block_bytes = 64 * 1024) : m_block_bytes(block_bytes), m_used(0), m_peak(0) {}
+
+    ~FrameAllocator()
+    {
+        for (size_t i = 0; i < m_blocks.size(); i++)
+            delete[] m_blocks[i].data;
+    }
+
+    void * allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        Block * block = m_blocks.empty() ? NULL : &m_blocks.back();
+        size_t offset = block ? (block->used + alignment - 1) & ~(alignment - 1) : 0;
+        if (!block || offset + bytes > block->size)
+        {
+            addBlock(std::max(m_block_bytes, bytes + alignment));
+            block = &m_blocks.back();
+            offset = 0;
+        }
+        block->used = offset + bytes;
+        m_used += bytes;
+        return block->data + offset;
+    }
+
+    template <typename T>
+    T * allocate(size_t count)
+    {
+        return (T *)allocate(count * sizeof(T), alignof(T));
+    }
+
+    // frees the whole frame
+    void reset()
+    {
+        m_peak = std::max(m_peak, m_used);
+        if (m_blocks.size() > 1)
+        {
+            size_t total = 0;
+            for (size_t i = 0; i < m_blocks.size(); i++)
+            {
+                total += m_blocks[i].size;
+                delete[] m_blocks[i].data;
+            }
+            m_blocks.clear();
+            m_block_bytes = std::max(m_block_bytes, total);
+            addBlock(m_block_bytes);
+        }
+        else if (!m_blocks.empty())
+            m_blocks.back().used = 0;
+        m_used = 0;
+    }
+
+    size_t used() const { return m_used; }
+    size_t peak() const { return std::max(m_peak, m_used); }
+
+    private:
+    FrameAllocator(const FrameAllocator &);
+    FrameAllocator & operator=(const FrameAllocator &);
+
+    struct Block
+    {
+        char * data;
+        size_t size;
+        size_t used;
+    };
+
+    void addBlock(size_t bytes)
+    {
+        Block block;
+        block.data = new char[bytes]; // aligned for any fundamental type
+        block.size = bytes;
+        block.used = 0;
+        m_blocks.push_back(block);
+    }
+
+    size_t m_block_bytes;
+    size_t m_used;
+    size_t m_peak;
+    std::vector<Block> m_blocks;
+};
@@ -0,0 +1,497 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gl_trace.h"
+
+// records the GL calls of the application into a trace (see gl_trace.h) by swapping the glad
+// function pointers with recording wrappers that forward to the driver.
+//
+//   gl_capture_install();   // right after the context is created, records resource creation
+//   gl_capture_begin_frame();
+//   display();
+//   gl_capture_end_frame();
+//   gl_capture_finish("frame.gltrace", width, height); // writes the trace, restores the pointers
+//
+// only the entry points the renderer uses are hooked; other calls go straight to the driver
+// and are not part of the trace. writes through glMapBufferRange are recorded at glUnmapBuffer as
+// a GLT_BUFFER_SUB_DATA of the mapped range; persistent mappings are never unmapped and not captured.
+
+// range mapped with glMapBufferRange, until glUnmapBuffer
+struct GlCaptureMapping
+{
+    GLenum target;
+    GLintptr offset;
+    GLsizeiptr length;
+    const void * pointer;
+};
+
+struct GlCaptureState
+{
+    bool installed;
+    std::vector<unsigned char> data;
+    std::vector<GlCaptureMapping> mappings;
+
+    PFNGLGENBUFFERSPROC gen_buffers;
+    PFNGLDELETEBUFFERSPROC delete_buffers;
+    PFNGLBINDBUFFERPROC bind_buffer;
+    PFNGLBUFFERDATAPROC buffer_data;
+    PFNGLBUFFERSUBDATAPROC buffer_sub_data;
+    PFNGLGENVERTEXARRAYSPROC gen_vertex_arrays;
+    PFNGLDELETEVERTEXARRAYSPROC delete_vertex_arrays;
+    PFNGLBINDVERTEXARRAYPROC bind_vertex_array;
+    PFNGLVERTEXATTRIBPOINTERPROC vertex_attrib_pointer;
+    PFNGLENABLEVERTEXATTRIBARRAYPROC enable_vertex_attrib_array;
+    PFNGLCREATESHADERPROC create_shader;
+    PFNGLSHADERSOURCEPROC shader_source;
+    PFNGLCOMPILESHADERPROC compile_shader;
+    PFNGLDELETESHADERPROC delete_shader;
+    PFNGLCREATEPROGRAMPROC create_program;
+    PFNGLATTACHSHADERPROC attach_shader;
+    PFNGLLINKPROGRAMPROC link_program;
+    PFNGLUSEPROGRAMPROC use_program;
+    PFNGLGETUNIFORMLOCATIONPROC get_uniform_location;
+    PFNGLUNIFORM1IPROC uniform_1i;
+    PFNGLUNIFORM1FPROC uniform_1f;
+    PFNGLUNIFORM3FPROC uniform_3f;
+    PFNGLUNIFORM3FVPROC uniform_3fv;
+    PFNGLUNIFORMMATRIX4FVPROC uniform_matrix_4fv;
+    PFNGLCLEARCOLORPROC clear_color;
+    PFNGLCLEARPROC clear;
+    PFNGLENABLEPROC enable;
+    PFNGLDISABLEPROC disable;
+    PFNGLCULLFACEPROC cull_face;
+    PFNGLPOLYGONMODEPROC polygon_mode;
+    PFNGLVIEWPORTPROC viewport;
+    PFNGLDRAWELEMENTSPROC draw_elements;
+    PFNGLCOPYBUFFERSUBDATAPROC copy_buffer_sub_data;
+    PFNGLDRAWELEMENTSBASEVERTEXPROC draw_elements_base_vertex;
+    PFNGLMAPBUFFERRANGEPROC map_buffer_range;
+    PFNGLUNMAPBUFFERPROC unmap_buffer;
+    PFNGLBINDBUFFERRANGEPROC bind_buffer_range;
+    PFNGLGETUNIFORMBLOCKINDEXPROC get_uniform_block_index;
+    PFNGLUNIFORMBLOCKBINDINGPROC uniform_block_binding;
+    PFNGLVERTEXATTRIBDIVISORPROC vertex_attrib_divisor;
+    PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC draw_elements_instanced_base_vertex;
+};
+
+inline GlCaptureState & gl_capture_state()
+{
+    static GlCaptureState state = GlCaptureState();
+    return state;
+}
+
+inline void gl_capture_record(GlTraceOp op, std::initializer_list<long long> args, const void * payload = NULL, size_t payload_size = 0)
+{
+    std::vector<unsigned char> & data = gl_capture_state().data;
+    const unsigned short op_code = (unsigned short)op;
+    const unsigned char arg_count = (unsigned char)args.size();
+    const unsigned char has_payload = payload != NULL;
+    const unsigned size = unsigned(payload_size);
+
+    size_t at = data.size();
+    data.resize(at + sizeof(op_code) + 2 + arg_count * sizeof(long long) + (has_payload ? sizeof(size) + size : 0));
+    memcpy(&data[at], &op_code, sizeof(op_code));
+    at += sizeof(op_code);
+    data[at++] = arg_count;
+    data[at++] = has_payload;
+    for (std::initializer_list<long long>::const_iterator arg = args.begin(); arg != args.end(); ++arg)
+    {
+        memcpy(&data[at], &*arg, sizeof(long long));
+        at += sizeof(long long);
+    }
+    if (has_payload)
+    {
+        memcpy(&data[at], &size, sizeof(size));
+        at += sizeof(size);
+        if (size)
+            memcpy(&data[at], payload, size);
+    }
+}
+
+// recording wrappers
+// ------------------
+
+static void APIENTRY gl_capture_gen_buffers(GLsizei n, GLuint * buffers)
+{
+    gl_capture_state().gen_buffers(n, buffers);
+    for (GLsizei i = 0; i < n; i++)
+        gl_capture_record(GLT_GEN_BUFFERS, { buffers[i] });
+}
+
+static void APIENTRY gl_capture_delete_buffers(GLsizei n, const GLuint * buffers)
+{
+    for (GLsizei i = 0; i < n; i++)
+        gl_capture_record(GLT_DELETE_BUFFERS, { buffers[i] });
+    gl_capture_state().delete_buffers(n, buffers);
+}
+
+static void APIENTRY gl_capture_bind_buffer(GLenum target, GLuint buffer)
+{
+    gl_capture_record(GLT_BIND_BUFFER, { target, buffer });
+    gl_capture_state().bind_buffer(target, buffer);
+}
+
+static void APIENTRY gl_capture_buffer_data(GLenum target, GLsizeiptr size, const void * data, GLenum usage)
+{
+    gl_capture_record(GLT_BUFFER_DATA, { target, (long long)size, usage, data != NULL }, data, data ? size_t(size) : 0);
+    gl_capture_state().buffer_data(target, size, data, usage);
+}
+
+static void APIENTRY gl_capture_buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const void * data)
+{
+    gl_capture_record(GLT_BUFFER_SUB_DATA, { target, (long long)offset, (long long)size }, data, size_t(size));
+    gl_capture_state().buffer_sub_data(target, offset, size, data);
+}
+
+static void APIENTRY gl_capture_gen_vertex_arrays(GLsizei n, GLuint * arrays)
+{
+    gl_capture_state().gen_vertex_arrays(n, arrays);
+    for (GLsizei i = 0; i < n; i++)
+        gl_capture_record(GLT_GEN_VERTEX_ARRAYS, { arrays[i] });
+}
+
+static void APIENTRY gl_capture_delete_vertex_arrays(GLsizei n, const GLuint * arrays)
+{
+    for (GLsizei i = 0; i < n; i++)
+        gl_capture_record(GLT_DELETE_VERTEX_ARRAYS, { arrays[i] });
+    gl_capture_state().delete_vertex_arrays(n, arrays);
+}
+
+static void APIENTRY gl_capture_bind_vertex_array(GLuint array)
+{
+    gl_capture_record(GLT_BIND_VERTEX_ARRAY, { array });
+    gl_capture_state().bind_vertex_array(array);
+}
+
+static void APIENTRY gl_capture_vertex_attrib_pointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void * pointer)
+{
+    gl_capture_record(GLT_VERTEX_ATTRIB_POINTER, { index, size, type, normalized, stride, (long long)(size_t)pointer });
+    gl_capture_state().vertex_attrib_pointer(index, size, type, normalized, stride, pointer);
+}
+
+static void APIENTRY gl_capture_enable_vertex_attrib_array(GLuint index)
+{
+    gl_capture_record(GLT_ENABLE_VERTEX_ATTRIB_ARRAY, { index });
+    gl_capture_state().enable_vertex_attrib_array(index);
+}
+
+static GLuint APIENTRY gl_capture_create_shader(GLenum type)
+{
+    GLuint shader = gl_capture_state().create_shader(type);
+    gl_capture_record(GLT_CREATE_SHADER, { type, shader });
+    return shader;
+}
+
+static void APIENTRY gl_capture_shader_source(GLuint shader, GLsizei count, const GLchar * const * strings, const GLint * lengths)
+{
+    std::string source;
+    for (GLsizei i = 0; i < count; i++)
+        source += lengths && lengths[i] >= 0 ? std::string(strings[i], lengths[i]) : std::string(strings[i]);
+    gl_capture_record(GLT_SHADER_SOURCE, { shader }, source.c_str(), source.size());
+    gl_capture_state().shader_source(shader, count, strings, lengths);
+}
+
+static void APIENTRY gl_capture_compile_shader(GLuint shader)
+{
+    gl_capture_record(GLT_COMPILE_SHADER, { shader });
+    gl_capture_state().compile_shader(shader);
+}
+
+static void APIENTRY gl_capture_delete_shader(GLuint shader)
+{
+    gl_capture_record(GLT_DELETE_SHADER, { shader });
+    gl_capture_state().delete_shader(shader);
+}
+
+static GLuint APIENTRY gl_capture_create_program()
+{
+    GLuint program = gl_capture_state().create_program();
+    gl_capture_record(GLT_CREATE_PROGRAM, { program });
+    return program;
+}
+
+static void APIENTRY gl_capture_attach_shader(GLuint program, GLuint shader)
+{
+    gl_capture_record(GLT_ATTACH_SHADER, { program, shader });
+    gl_capture_state().attach_shader(program, shader);
+}
+
+static void APIENTRY gl_capture_link_program(GLuint program)
+{
+    gl_capture_record(GLT_LINK_PROGRAM, { program });
+    gl_capture_state().link_program(program);
+}
+
+static void APIENTRY gl_capture_use_program(GLuint program)
+{
+    gl_capture_record(GLT_USE_PROGRAM, { program });
+    gl_capture_state().use_program(program);
+}
+
+static GLint APIENTRY gl_capture_get_uniform_location(GLuint program, const GLchar * name)
+{
+    GLint location = gl_capture_state().get_uniform_location(program, name);
+    gl_capture_record(GLT_GET_UNIFORM_LOCATION, { program, location }, name, strlen(name));
+    return location;
+}
+
+static void APIENTRY gl_capture_uniform_1i(GLint location, GLint v0)
+{
+    gl_capture_record(GLT_UNIFORM_1I, { location, v0 });
+    gl_capture_state().uniform_1i(location, v0);
+}
+
+static void APIENTRY gl_capture_uniform_1f(GLint location, GLfloat v0)
+{
+    gl_capture_record(GLT_UNIFORM_1F, { location, gl_trace_float_arg(v0) });
+    gl_capture_state().uniform_1f(location, v0);
+}
+
+static void APIENTRY gl_capture_uniform_3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+    gl_capture_record(GLT_UNIFORM_3F, { location, gl_trace_float_arg(v0), gl_trace_float_arg(v1), gl_trace_float_arg(v2) });
+    gl_capture_state().uniform_3f(location, v0, v1, v2);
+}
+
+static void APIENTRY gl_capture_uniform_3fv(GLint location, GLsizei count, const GLfloat * value)
+{
+    gl_capture_record(GLT_UNIFORM_3FV, { location, count }, value, count * 3 * sizeof(GLfloat));
+    gl_capture_state().uniform_3fv(location, count, value);
+}
+
+static void APIENTRY gl_capture_uniform_matrix_4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat * value)
+{
+    gl_capture_record(GLT_UNIFORM_MATRIX_4FV, { location, count, transpose }, value, count * 16 * sizeof(GLfloat));
+    gl_capture_state().uniform_matrix_4fv(location, count, transpose, value);
+}
+
+static void APIENTRY gl_capture_clear_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+    gl_capture_record(GLT_CLEAR_COLOR, { gl_trace_float_arg(r), gl_trace_float_arg(g), gl_trace_float_arg(b), gl_trace_float_arg(a) });
+    gl_capture_state().clear_color(r, g, b, a);
+}
+
+static void APIENTRY gl_capture_clear(GLbitfield mask)
+{
+    gl_capture_record(GLT_CLEAR, { mask });
+    gl_capture_state().clear(mask);
+}
+
+static void APIENTRY gl_capture_enable(GLenum cap)
+{
+    gl_capture_record(GLT_ENABLE, { cap });
+    gl_capture_state().enable(cap);
+}
+
+static void APIENTRY gl_capture_disable(GLenum cap)
+{
+    gl_capture_record(GLT_DISABLE, { cap });
+    gl_capture_state().disable(cap);
+}
+
+static void APIENTRY gl_capture_cull_face(GLenum mode)
+{
+    gl_capture_record(GLT_CULL_FACE, { mode });
+    gl_capture_state().cull_face(mode);
+}
+
+static void APIENTRY gl_capture_polygon_mode(GLenum face, GLenum mode)
+{
+    gl_capture_record(GLT_POLYGON_MODE, { face, mode });
+    gl_capture_state().polygon_mode(face, mode);
+}
+
+static void APIENTRY gl_capture_viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    gl_capture_record(GLT_VIEWPORT, { x, y, width, height });
+    gl_capture_state().viewport(x, y, width, height);
+}
+
+static void APIENTRY gl_capture_draw_elements(GLenum mode, GLsizei count, GLenum type, const void * indices)
+{
+    gl_capture_record(GLT_DRAW_ELEMENTS, { mode, count, type, (long long)(size_t)indices });
+    gl_capture_state().draw_elements(mode, count, type, indices);
+}
+
+static void APIENTRY gl_capture_copy_buffer_sub_data(GLenum read_target, GLenum write_target, GLintptr read_offset, GLintptr write_offset, GLsizeiptr size)
+{
+    gl_capture_record(GLT_COPY_BUFFER_SUB_DATA, { read_target, write_target, (long long)read_offset, (long long)write_offset, (long long)size });
+    gl_capture_state().copy_buffer_sub_data(read_target, write_target, read_offset, write_offset, size);
+}
+
+static void APIENTRY gl_capture_draw_elements_base_vertex(GLenum mode, GLsizei count, GLenum type, const void * indices, GLint base_vertex)
+{
+    gl_capture_record(GLT_DRAW_ELEMENTS_BASE_VERTEX, { mode, count, type, (long long)(size_t)indices, base_vertex });
+    gl_capture_state().draw_elements_base_vertex(mode, count, type, indices, base_vertex);
+}
+
+static void * APIENTRY gl_capture_map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    void * pointer = gl_capture_state().map_buffer_range(target, offset, length, access);
+    if (pointer && (access & GL_MAP_WRITE_BIT))
+    {
+        GlCaptureMapping mapping = { target, offset, length, pointer };
+        gl_capture_state().mappings.push_back(mapping);
+    }
+    return pointer;
+}
+
+static GLboolean APIENTRY gl_capture_unmap_buffer(GLenum target)
+{
+    std::vector<GlCaptureMapping> & mappings = gl_capture_state().mappings;
+    for (size_t i = 0; i < mappings.size(); i++)
+        if (mappings[i].target == target)
+        {
+            const GlCaptureMapping & mapping = mappings[i];
+            gl_capture_record(GLT_BUFFER_SUB_DATA, { target, (long long)mapping.offset, (long long)mapping.length }, mapping.pointer, size_t(mapping.length));
+            mappings.erase(mappings.begin() + i);
+            break;
+        }
+    return gl_capture_state().unmap_buffer(target);
+}
+
+static void APIENTRY gl_capture_bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    gl_capture_record(GLT_BIND_BUFFER_RANGE, { target, index, buffer, (long long)offset, (long long)size });
+    gl_capture_state().bind_buffer_range(target, index, buffer, offset, size);
+}
+
+static GLuint APIENTRY gl_capture_get_uniform_block_index(GLuint program, const GLchar * name)
+{
+    GLuint index = gl_capture_state().get_uniform_block_index(program, name);
+    gl_capture_record(GLT_GET_UNIFORM_BLOCK_INDEX, { program, index }, name, strlen(name));
+    return index;
+}
+
+static void APIENTRY gl_capture_uniform_block_binding(GLuint program, GLuint index, GLuint binding)
+{
+    gl_capture_record(GLT_UNIFORM_BLOCK_BINDING, { program, index, binding });
+    gl_capture_state().uniform_block_binding(program, index, binding);
+}
+
+static void APIENTRY gl_capture_vertex_attrib_divisor(GLuint index, GLuint divisor)
+{
+    gl_capture_record(GLT_VERTEX_ATTRIB_DIVISOR, { index, divisor });
+    gl_capture_state().vertex_attrib_divisor(index, divisor);
+}
+
+static void APIENTRY gl_capture_draw_elements_instanced_base_vertex(GLenum mode, GLsizei count, GLenum type, const void * indices,
+                                                                    GLsizei instances, GLint base_vertex)
+{
+    gl_capture_record(GLT_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX, { mode, count, type, (long long)(size_t)indices, instances, base_vertex });
+    gl_capture_state().draw_elements_instanced_base_vertex(mode, count, type, indices, instances, base_vertex);
+}
+
+// install / uninstall
+// -------------------
+
+#define GL_CAPTURE_HOOK(member, glad_pointer, wrapper) \
+    state.member = glad_pointer;                        \
+    glad_pointer = wrapper;
+
+#define GL_CAPTURE_UNHOOK(member, glad_pointer, wrapper) \
+    glad_pointer = state.member;
+
+#define GL_CAPTURE_ENTRY_POINTS(X)                                                   \
+    X(gen_buffers, glad_glGenBuffers, gl_capture_gen_buffers)                        \
+    X(delete_buffers, glad_glDeleteBuffers, gl_capture_delete_buffers)               \
+    X(bind_buffer, glad_glBindBuffer, gl_capture_bind_buffer)                        \
+    X(buffer_data, glad_glBufferData, gl_capture_buffer_data)                        \
+    X(buffer_sub_data, glad_glBufferSubData, gl_capture_buffer_sub_data)             \
+    X(gen_vertex_arrays, glad_glGenVertexArrays, gl_capture_gen_vertex_arrays)       \
+    X(delete_vertex_arrays, glad_glDeleteVertexArrays, gl_capture_delete_vertex_arrays) \
+    X(bind_vertex_array, glad_glBindVertexArray, gl_capture_bind_vertex_array)       \
+    X(vertex_attrib_pointer, glad_glVertexAttribPointer, gl_capture_vertex_attrib_pointer) \
+    X(enable_vertex_attrib_array, glad_glEnableVertexAttribArray, gl_capture_enable_vertex_attrib_array) \
+    X(create_shader, glad_glCreateShader, gl_capture_create_shader)                  \
+    X(shader_source, glad_glShaderSource, gl_capture_shader_source)                  \
+    X(compile_shader, glad_glCompileShader, gl_capture_compile_shader)               \
+    X(delete_shader, glad_glDeleteShader, gl_capture_delete_shader)                  \
+    X(create_program, glad_glCreateProgram, gl_capture_create_program)               \
+    X(attach_shader, glad_glAttachShader, gl_capture_attach_shader)                  \
+    X(link_program, glad_glLinkProgram, gl_capture_link_program)                     \
+    X(use_program, glad_glUseProgram, gl_capture_use_program)                        \
+    X(get_uniform_location, glad_glGetUniformLocation, gl_capture_get_uniform_location) \
+    X(uniform_1i, glad_glUniform1i, gl_capture_uniform_1i)                           \
+    X(uniform_1f, glad_glUniform1f, gl_capture_uniform_1f)                           \
+    X(uniform_3f, glad_glUniform3f, gl_capture_uniform_3f)                           \
+    X(uniform_3fv, glad_glUniform3fv, gl_capture_uniform_3fv)                        \
+    X(uniform_matrix_4fv, glad_glUniformMatrix4fv, gl_capture_uniform_matrix_4fv)    \
+    X(clear_color, glad_glClearColor, gl_capture_clear_color)                        \
+    X(clear, glad_glClear, gl_capture_clear)                                         \
+    X(enable, glad_glEnable, gl_capture_enable)                                      \
+    X(disable, glad_glDisable, gl_capture_disable)                                   \
+    X(cull_face, glad_glCullFace, gl_capture_cull_face)                              \
+    X(polygon_mode, glad_glPolygonMode, gl_capture_polygon_mode)                     \
+    X(viewport, glad_glViewport, gl_capture_viewport)                                \
+    X(draw_elements, glad_glDrawElements, gl_capture_draw_elements)                  \
+    X(copy_buffer_sub_data, glad_glCopyBufferSubData, gl_capture_copy_buffer_sub_data) \
+    X(draw_elements_base_vertex, glad_glDrawElementsBaseVertex, gl_capture_draw_elements_base_vertex) \
+    X(map_buffer_range, glad_glMapBufferRange, gl_capture_map_buffer_range)          \
+    X(unmap_buffer, glad_glUnmapBuffer, gl_capture_unmap_buffer)                     \
+    X(bind_buffer_range, glad_glBindBufferRange, gl_capture_bind_buffer_range)       \
+    X(get_uniform_block_index, glad_glGetUniformBlockIndex, gl_capture_get_uniform_block_index) \
+    X(uniform_block_binding, glad_glUniformBlockBinding, gl_capture_uniform_block_binding) \
+    X(vertex_attrib_divisor, glad_glVertexAttribDivisor, gl_capture_vertex_attrib_divisor) \
+    X(draw_elements_instanced_base_vertex, glad_glDrawElementsInstancedBaseVertex, gl_capture_draw_elements_instanced_base_vertex)
+
+// starts recording, must be called after glad is loaded
+inline void gl_capture_install()
+{
+    GlCaptureState & state = gl_capture_state();
+    if (state.installed)
+        return;
+    state.installed = true;
+    state.data.clear();
+    GL_CAPTURE_ENTRY_POINTS(GL_CAPTURE_HOOK)
+}
+
+inline bool gl_capture_installed()
+{
+    return gl_capture_state().installed;
+}
+
+inline void gl_capture_begin_frame()
+{
+    gl_capture_record(GLT_FRAME_BEGIN, {});
+}
+
+inline void gl_capture_end_frame()
+{
+    gl_capture_record(GLT_FRAME_END, {});
+}
+
+// writes the trace and restores the original entry points
+inline bool gl_capture_finish(const std::string & filename, unsigned width, unsigned height)
+{
+    GlCaptureState & state = gl_capture_state();
+    if (!state.installed)
+        return false;
+    GL_CAPTURE_ENTRY_POINTS(GL_CAPTURE_UNHOOK)
+    state.installed = false;
+
+    FILE * file = fopen(filename.c_str(), "wb");
+    if (!file)
+    {
+        std::cout << "Could not open GL trace for writing: \"" << filename << "\"" << std::endl;
+        return false;
+    }
+    fwrite(GL_TRACE_MAGIC, 1, 4, file);
+    fwrite(&GL_TRACE_VERSION, sizeof(GL_TRACE_VERSION), 1, file);
+    fwrite(&width, sizeof(width), 1, file);
+    fwrite(&height, sizeof(height), 1, file);
+    fwrite(state.data.data(), 1, state.data.size(), file);
+    fclose(file);
+
+    std::vector<unsigned char>().swap(state.data);
+    state.mappings.clear();
+    return true;
+}
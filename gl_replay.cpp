@@ -0,0 +1,281 @@
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "gl_trace.h"
+#include "init_offscreen.h"
+#include "offscreen_framebuffer.h"
+
+// replays a frame captured with esame_10 --capture in a loop, on a surfaceless context,
+// and reports the submission throughput: no window, input or asset loading involved.
+// usage: gl_replay trace.gltrace [--iterations N]
+
+class GlTracePlayer
+{
+    public:
+    GlTracePlayer(const GlTrace & trace) : m_trace(trace), m_program(0), m_calls(0), m_draws(0) {}
+
+    void run(const std::vector<GlTraceCommand> & commands)
+    {
+        for (size_t i = 0; i < commands.size(); i++)
+            execute(commands[i]);
+    }
+
+    // GL calls and draw calls issued so far
+    long long calls() const { return m_calls; }
+    long long draws() const { return m_draws; }
+
+    private:
+    // object names and uniform locations differ between the capture and the replay
+    GLuint buffer(long long name) { return name ? m_buffers[GLuint(name)] : 0; }
+    GLuint vertexArray(long long name) { return name ? m_vertex_arrays[GLuint(name)] : 0; }
+    GLuint shader(long long name) { return m_shaders[GLuint(name)]; }
+    GLuint program(long long name) { return name ? m_programs[GLuint(name)] : 0; }
+    GLint location(long long old_location)
+    {
+        std::map<std::pair<GLuint, GLint>, GLint>::const_iterator it = m_locations.find(std::make_pair(m_program, GLint(old_location)));
+        return it != m_locations.end() ? it->second : -1;
+    }
+
+    GLuint blockIndex(long long captured_program, long long old_index)
+    {
+        std::map<std::pair<GLuint, GLuint>, GLuint>::const_iterator it = m_block_indices.find(std::make_pair(GLuint(captured_program), GLuint(old_index)));
+        return it != m_block_indices.end() ? it->second : GL_INVALID_INDEX;
+    }
+
+    const void * payload(const GlTraceCommand & c) const
+    {
+        return c.payload_size ? &m_trace.payload[c.payload_offset] : NULL;
+    }
+
+    void execute(const GlTraceCommand & c)
+    {
+        const long long * a = c.args;
+        m_calls++;
+        switch (c.op)
+        {
+        case GLT_GEN_BUFFERS:
+            glGenBuffers(1, &m_buffers[GLuint(a[0])]);
+            break;
+        case GLT_DELETE_BUFFERS:
+            glDeleteBuffers(1, &m_buffers[GLuint(a[0])]);
+            m_buffers.erase(GLuint(a[0]));
+            break;
+        case GLT_BIND_BUFFER:
+            glBindBuffer(GLenum(a[0]), buffer(a[1]));
+            break;
+        case GLT_BUFFER_DATA:
+            glBufferData(GLenum(a[0]), GLsizeiptr(a[1]), a[3] ? payload(c) : NULL, GLenum(a[2]));
+            break;
+        case GLT_BUFFER_SUB_DATA:
+            glBufferSubData(GLenum(a[0]), GLintptr(a[1]), GLsizeiptr(a[2]), payload(c));
+            break;
+        case GLT_GEN_VERTEX_ARRAYS:
+            glGenVertexArrays(1, &m_vertex_arrays[GLuint(a[0])]);
+            break;
+        case GLT_DELETE_VERTEX_ARRAYS:
+            glDeleteVertexArrays(1, &m_vertex_arrays[GLuint(a[0])]);
+            m_vertex_arrays.erase(GLuint(a[0]));
+            break;
+        case GLT_BIND_VERTEX_ARRAY:
+            glBindVertexArray(vertexArray(a[0]));
+            break;
+        case GLT_VERTEX_ATTRIB_POINTER:
+            glVertexAttribPointer(GLuint(a[0]), GLint(a[1]), GLenum(a[2]), GLboolean(a[3]), GLsizei(a[4]), (const void *)(size_t)a[5]);
+            break;
+        case GLT_ENABLE_VERTEX_ATTRIB_ARRAY:
+            glEnableVertexAttribArray(GLuint(a[0]));
+            break;
+        case GLT_CREATE_SHADER:
+            m_shaders[GLuint(a[1])] = glCreateShader(GLenum(a[0]));
+            break;
+        case GLT_SHADER_SOURCE:
+        {
+            const GLchar * source = (const GLchar *)payload(c);
+            const GLint length = GLint(c.payload_size);
+            glShaderSource(shader(a[0]), 1, &source, &length);
+            break;
+        }
+        case GLT_COMPILE_SHADER:
+            glCompileShader(shader(a[0]));
+            break;
+        case GLT_DELETE_SHADER:
+            glDeleteShader(shader(a[0]));
+            break;
+        case GLT_CREATE_PROGRAM:
+            m_programs[GLuint(a[0])] = glCreateProgram();
+            break;
+        case GLT_ATTACH_SHADER:
+            glAttachShader(program(a[0]), shader(a[1]));
+            break;
+        case GLT_LINK_PROGRAM:
+            glLinkProgram(program(a[0]));
+            break;
+        case GLT_USE_PROGRAM:
+            m_program = GLuint(a[0]);
+            glUseProgram(program(a[0]));
+            break;
+        case GLT_GET_UNIFORM_LOCATION:
+        {
+            std::string name((const char *)payload(c), c.payload_size);
+            m_locations[std::make_pair(GLuint(a[0]), GLint(a[1]))] = glGetUniformLocation(program(a[0]), name.c_str());
+            break;
+        }
+        case GLT_UNIFORM_1I:
+            glUniform1i(location(a[0]), GLint(a[1]));
+            break;
+        case GLT_UNIFORM_1F:
+            glUniform1f(location(a[0]), c.argf(1));
+            break;
+        case GLT_UNIFORM_3F:
+            glUniform3f(location(a[0]), c.argf(1), c.argf(2), c.argf(3));
+            break;
+        case GLT_UNIFORM_3FV:
+            glUniform3fv(location(a[0]), GLsizei(a[1]), (const GLfloat *)payload(c));
+            break;
+        case GLT_UNIFORM_MATRIX_4FV:
+            glUniformMatrix4fv(location(a[0]), GLsizei(a[1]), GLboolean(a[2]), (const GLfloat *)payload(c));
+            break;
+        case GLT_CLEAR_COLOR:
+            glClearColor(c.argf(0), c.argf(1), c.argf(2), c.argf(3));
+            break;
+        case GLT_CLEAR:
+            glClear(GLbitfield(a[0]));
+            break;
+        case GLT_ENABLE:
+            glEnable(GLenum(a[0]));
+            break;
+        case GLT_DISABLE:
+            glDisable(GLenum(a[0]));
+            break;
+        case GLT_CULL_FACE:
+            glCullFace(GLenum(a[0]));
+            break;
+        case GLT_POLYGON_MODE:
+            glPolygonMode(GLenum(a[0]), GLenum(a[1]));
+            break;
+        case GLT_VIEWPORT:
+            glViewport(GLint(a[0]), GLint(a[1]), GLsizei(a[2]), GLsizei(a[3]));
+            break;
+        case GLT_DRAW_ELEMENTS:
+            glDrawElements(GLenum(a[0]), GLsizei(a[1]), GLenum(a[2]), (const void *)(size_t)a[3]);
+            m_draws++;
+            break;
+        case GLT_COPY_BUFFER_SUB_DATA:
+            glCopyBufferSubData(GLenum(a[0]), GLenum(a[1]), GLintptr(a[2]), GLintptr(a[3]), GLsizeiptr(a[4]));
+            break;
+        case GLT_DRAW_ELEMENTS_BASE_VERTEX:
+            glDrawElementsBaseVertex(GLenum(a[0]), GLsizei(a[1]), GLenum(a[2]), (const void *)(size_t)a[3], GLint(a[4]));
+            m_draws++;
+            break;
+        case GLT_BIND_BUFFER_RANGE:
+            glBindBufferRange(GLenum(a[0]), GLuint(a[1]), buffer(a[2]), GLintptr(a[3]), GLsizeiptr(a[4]));
+            break;
+        case GLT_GET_UNIFORM_BLOCK_INDEX:
+        {
+            std::string name((const char *)payload(c), c.payload_size);
+            m_block_indices[std::make_pair(GLuint(a[0]), GLuint(a[1]))] = glGetUniformBlockIndex(program(a[0]), name.c_str());
+            break;
+        }
+        case GLT_UNIFORM_BLOCK_BINDING:
+        {
+            const GLuint index = blockIndex(a[0], a[1]);
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(program(a[0]), index, GLuint(a[2]));
+            break;
+        }
+        case GLT_VERTEX_ATTRIB_DIVISOR:
+            glVertexAttribDivisor(GLuint(a[0]), GLuint(a[1]));
+            break;
+        case GLT_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX:
+            glDrawElementsInstancedBaseVertex(GLenum(a[0]), GLsizei(a[1]), GLenum(a[2]), (const void *)(size_t)a[3], GLsizei(a[4]), GLint(a[5]));
+            m_draws++;
+            break;
+        default:
+            m_calls--;
+            break;
+        }
+    }
+
+    const GlTrace & m_trace;
+    std::map<GLuint, GLuint> m_buffers;
+    std::map<GLuint, GLuint> m_vertex_arrays;
+    std::map<GLuint, GLuint> m_shaders;
+    std::map<GLuint, GLuint> m_programs;
+    std::map<std::pair<GLuint, GLint>, GLint> m_locations; // (captured program, captured location) -> location
+    std::map<std::pair<GLuint, GLuint>, GLuint> m_block_indices; // (captured program, captured block index) -> block index
+    GLuint m_program; // captured name of the current program
+    long long m_calls;
+    long long m_draws;
+};
+
+int main(int argc, char ** argv)
+{
+    const char * trace_filename = NULL;
+    int iterations = 1000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+            iterations = std::max(1, atoi(argv[++i]));
+        else if (!trace_filename && argv[i][0] != '-')
+            trace_filename = argv[i];
+        else
+        {
+            trace_filename = NULL;
+            break;
+        }
+    }
+    if (!trace_filename)
+    {
+        std::cout << "usage: " << argv[0] << " trace.gltrace [--iterations N]" << std::endl;
+        return 1;
+    }
+
+    GlTrace trace;
+    if (!gl_trace_load(trace_filename, trace))
+        return 1;
+
+    init_offscreen();
+    OffscreenFramebuffer framebuffer(trace.width, trace.height);
+    framebuffer.bind();
+
+    GlTracePlayer player(trace);
+    player.run(trace.setup);
+    player.run(trace.frame); // warm-up: shader compilation, first use of the buffers
+    glFinish();
+
+    const long long calls_before = player.calls();
+    const long long draws_before = player.draws();
+
+    // submission only, then including the time for the GPU to drain the queue
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        player.run(trace.frame);
+    std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+    glFinish();
+    std::chrono::steady_clock::time_point finished = std::chrono::steady_clock::now();
+
+    const double submit_ms = std::chrono::duration<double, std::milli>(submitted - start).count();
+    const double total_ms = std::chrono::duration<double, std::milli>(finished - start).count();
+    const long long calls = player.calls() - calls_before;
+    const long long draws = player.draws() - draws_before;
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"renderer\": \"" << (const char *)glGetString(GL_RENDERER) << "\"," << std::endl;
+    std::cout << "  \"trace\": \"" << trace_filename << "\", \"width\": " << trace.width << ", \"height\": " << trace.height << "," << std::endl;
+    std::cout << "  \"iterations\": " << iterations << ", \"calls_per_frame\": " << calls / iterations
+              << ", \"draws_per_frame\": " << draws / iterations << "," << std::endl;
+    std::cout << "  \"submit_ms_per_frame\": " << submit_ms / iterations << ", \"total_ms_per_frame\": " << total_ms / iterations << "," << std::endl;
+    std::cout << "  \"frames_per_second\": " << iterations / (total_ms / 1000.0)
+              << ", \"calls_per_second\": " << calls / (submit_ms / 1000.0)
+              << ", \"draws_per_second\": " << draws / (submit_ms / 1000.0) << std::endl;
+    std::cout << "}" << std::endl;
+    return 0;
+}
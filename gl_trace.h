@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// GL trace file, written by gl_capture.h and played back by gl_replay.
+// layout: "GLTR" magic, uint32 version, uint32 viewport width, uint32 viewport height, then records:
+//   uint16 op, uint8 argument count, uint8 has payload, int64 arguments[count],
+//   [uint32 payload size, payload bytes]
+// floats are stored bit-for-bit in the low 32 bits of an argument.
+// the calls before GLT_FRAME_BEGIN create the resources, the calls between GLT_FRAME_BEGIN and
+// GLT_FRAME_END are one frame. values are in host byte order.
+
+enum GlTraceOp
+{
+    GLT_FRAME_BEGIN = 0,
+    GLT_FRAME_END,
+
+    GLT_GEN_BUFFERS,            // name
+    GLT_DELETE_BUFFERS,         // name
+    GLT_BIND_BUFFER,            // target, name
+    GLT_BUFFER_DATA,            // target, size, usage, has data; payload: data
+    GLT_BUFFER_SUB_DATA,        // target, offset, size; payload: data
+    GLT_GEN_VERTEX_ARRAYS,      // name
+    GLT_DELETE_VERTEX_ARRAYS,   // name
+    GLT_BIND_VERTEX_ARRAY,      // name
+    GLT_VERTEX_ATTRIB_POINTER,  // index, size, type, normalized, stride, offset
+    GLT_ENABLE_VERTEX_ATTRIB_ARRAY, // index
+
+    GLT_CREATE_SHADER,          // type, name
+    GLT_SHADER_SOURCE,          // shader; payload: source
+    GLT_COMPILE_SHADER,         // shader
+    GLT_DELETE_SHADER,          // shader
+    GLT_CREATE_PROGRAM,         // name
+    GLT_ATTACH_SHADER,          // program, shader
+    GLT_LINK_PROGRAM,           // program
+    GLT_USE_PROGRAM,            // program
+    GLT_GET_UNIFORM_LOCATION,   // program, location; payload: uniform name
+
+    GLT_UNIFORM_1I,             // location, v0
+    GLT_UNIFORM_1F,             // location, v0
+    GLT_UNIFORM_3F,             // location, v0, v1, v2
+    GLT_UNIFORM_3FV,            // location, count; payload: values
+    GLT_UNIFORM_MATRIX_4FV,     // location, count, transpose; payload: values
+
+    GLT_CLEAR_COLOR,            // r, g, b, a
+    GLT_CLEAR,                  // mask
+    GLT_ENABLE,                 // cap
+    GLT_DISABLE,                // cap
+    GLT_CULL_FACE,              // mode
+    GLT_POLYGON_MODE,           // face, mode
+    GLT_VIEWPORT,               // x, y, width, height
+    GLT_DRAW_ELEMENTS,          // mode, count, type, offset
+    GLT_COPY_BUFFER_SUB_DATA,   // read target, write target, read offset, write offset, size
+    GLT_DRAW_ELEMENTS_BASE_VERTEX, // mode, count, type, offset, base vertex
+    GLT_BIND_BUFFER_RANGE,      // target, index, buffer, offset, size
+    GLT_GET_UNIFORM_BLOCK_INDEX, // program, block index; payload: block name
+    GLT_UNIFORM_BLOCK_BINDING,  // program, block index, binding
+    GLT_VERTEX_ATTRIB_DIVISOR,  // index, divisor
+    GLT_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX, // mode, count, type, offset, instances, base vertex
+
+    GLT_OP_COUNT
+};
+
+static const char GL_TRACE_MAGIC[4] = { 'G', 'L', 'T', 'R' };
+// bumped whenever the op set changes, so a gl_replay never plays a trace with ops it does not know.
+// 2: base vertex draws, uniform buffers, instancing
+static const unsigned GL_TRACE_VERSION = 2;
+
+struct GlTraceCommand
+{
+    unsigned short op;
+    unsigned char arg_count;
+    long long args[8];
+    size_t payload_offset; // in GlTrace::payload
+    size_t payload_size;   // 0: no payload
+
+    float argf(int i) const
+    {
+        float f;
+        unsigned bits = unsigned(args[i]);
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+};
+
+struct GlTrace
+{
+    unsigned width;
+    unsigned height;
+    std::vector<GlTraceCommand> setup; // resource creation, replayed once
+    std::vector<GlTraceCommand> frame; // replayed in a loop
+    std::vector<unsigned char> payload;
+};
+
+inline long long gl_trace_float_arg(float f)
+{
+    unsigned bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+// loads a whole trace in memory, so that replaying does no parsing
+inline bool gl_trace_load(const std::string & filename, GlTrace & trace)
+{
+    FILE * file = fopen(filename.c_str(), "rb");
+    if (!file)
+    {
+        std::cout << "Could not open GL trace: \"" << filename << "\"" << std::endl;
+        return false;
+    }
+
+    char magic[4];
+    unsigned version = 0;
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, GL_TRACE_MAGIC, 4) != 0 ||
+        fread(&version, sizeof(version), 1, file) != 1 || version != GL_TRACE_VERSION ||
+        fread(&trace.width, sizeof(trace.width), 1, file) != 1 || fread(&trace.height, sizeof(trace.height), 1, file) != 1)
+    {
+        std::cout << "ERROR::GL_TRACE:: \"" << filename << "\" is not a version " << GL_TRACE_VERSION << " GL trace" << std::endl;
+        fclose(file);
+        return false;
+    }
+
+    std::vector<GlTraceCommand> * section = &trace.setup;
+    GlTraceCommand command;
+    unsigned char has_payload;
+    bool ok = true;
+    while (fread(&command.op, sizeof(command.op), 1, file) == 1)
+    {
+        ok = fread(&command.arg_count, 1, 1, file) == 1 && fread(&has_payload, 1, 1, file) == 1 &&
+             command.op < GLT_OP_COUNT && command.arg_count <= 8 &&
+             fread(command.args, sizeof(long long), command.arg_count, file) == command.arg_count;
+        command.payload_offset = trace.payload.size();
+        command.payload_size = 0;
+        if (ok && has_payload)
+        {
+            unsigned size = 0;
+            ok = fread(&size, sizeof(size), 1, file) == 1;
+            if (ok)
+            {
+                trace.payload.resize(trace.payload.size() + size);
+                ok = fread(trace.payload.data() + command.payload_offset, 1, size, file) == size;
+                command.payload_size = size;
+            }
+        }
+        if (!ok)
+            break;
+
+        if (command.op == GLT_FRAME_BEGIN)
+            section = &trace.frame;
+        else if (command.op == GLT_FRAME_END)
+            break;
+        else
+            section->push_back(command);
+    }
+    fclose(file);
+
+    if (!ok)
+        std::cout << "ERROR::GL_TRACE:: truncated or corrupted record in \"" << filename << "\"" << std::endl;
+    return ok;
+}
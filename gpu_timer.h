@@ -0,0 +1,215 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+
+#include "profiler.h"
+
+// GPU timing with GL_TIMESTAMP queries that never stall the pipeline:
+// the queries issued in a frame are read back LATENCY frames later, when the GPU is done with them.
+// query objects are pooled per frame slot and reused.
+//
+//   gpu_timer.beginFrame();
+//   { GpuZone zone("frame"); ... GpuZone draw("tree"); ... }
+//   gpu_timer.endFrame();
+//   gpu_timer.results() // zones of an older frame, resolved by beginFrame()
+//
+// resolved zones are also added to the profiler trace, on a separate "GPU" track.
+
+struct GpuTiming
+{
+    long long frame;   // frame index passed to beginFrame()
+    const char * name;
+    long long start_ns; // on the profiler (CPU) clock
+    long long end_ns;
+    int depth;         // nesting level, 0 for outermost zones
+};
+
+class GpuTimer
+{
+    public:
+    static const int LATENCY = 4;
+
+    GpuTimer()
+    {
+        m_frame = -1;
+        m_depth = 0;
+        m_dropped = 0;
+
+        // offset between the GPU and the CPU clock, to place GPU zones on the CPU timeline
+        GLint64 gpu_now = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+        m_clock_offset = profiler_now_ns() - gpu_now;
+    }
+
+    ~GpuTimer()
+    {
+        for (int i = 0; i < LATENCY; i++)
+            if (!m_slots[i].queries.empty())
+                glDeleteQueries(GLsizei(m_slots[i].queries.size()), m_slots[i].queries.data());
+        if (activeTimer() == this)
+            activeTimer() = NULL;
+    }
+
+    // starts recording a frame and resolves the frame recorded LATENCY frames ago
+    void beginFrame()
+    {
+        activeTimer() = this;
+        m_frame++;
+        m_results.clear();
+
+        Slot & slot = m_slots[m_frame % LATENCY];
+        resolve(slot, false);
+        slot.frame = m_frame;
+        slot.used = 0;
+        slot.scopes.clear();
+        m_depth = 0;
+    }
+
+    void endFrame()
+    {
+        activeTimer() = NULL;
+    }
+
+    // waits for and resolves every pending frame (e.g. at exit), oldest first
+    void finish()
+    {
+        m_results.clear();
+        for (int i = 1; i <= LATENCY; i++)
+            resolve(m_slots[(m_frame + i) % LATENCY], true);
+    }
+
+    // zones resolved by the last beginFrame() or finish()
+    const std::vector<GpuTiming> & results() const { return m_results; }
+
+    // frames whose queries were not ready after LATENCY frames and were discarded
+    long long dropped() const { return m_dropped; }
+
+    // the timer recording the current frame, NULL outside beginFrame()/endFrame()
+    static GpuTimer * active() { return activeTimer(); }
+
+    int begin(const char * name)
+    {
+        Slot & slot = m_slots[m_frame % LATENCY];
+        Scope scope;
+        scope.name = name;
+        scope.begin_query = timestamp(slot);
+        scope.end_query = -1;
+        scope.depth = m_depth++;
+        slot.scopes.push_back(scope);
+        return int(slot.scopes.size()) - 1;
+    }
+
+    void end(int scope)
+    {
+        Slot & slot = m_slots[m_frame % LATENCY];
+        slot.scopes[scope].end_query = timestamp(slot);
+        m_depth--;
+    }
+
+    private:
+    struct Scope
+    {
+        const char * name;
+        int begin_query;
+        int end_query;
+        int depth;
+    };
+
+    struct Slot
+    {
+        Slot() : frame(-1), used(0) {}
+
+        long long frame;
+        std::vector<GLuint> queries; // pool, grows to the number of timestamps of a frame
+        size_t used;
+        std::vector<Scope> scopes;
+    };
+
+    int timestamp(Slot & slot)
+    {
+        if (slot.used == slot.queries.size())
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            slot.queries.push_back(query);
+        }
+        glQueryCounter(slot.queries[slot.used], GL_TIMESTAMP);
+        return int(slot.used++);
+    }
+
+    void resolve(Slot & slot, bool wait)
+    {
+        if (slot.scopes.empty() || slot.used == 0)
+            return;
+
+        // timestamps complete in order: if the last one is available, all of them are
+        GLint available = GL_FALSE;
+        if (!wait)
+            glGetQueryObjectiv(slot.queries[slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!wait && !available)
+        {
+            m_dropped++;
+            slot.scopes.clear();
+            return;
+        }
+
+        std::vector<GLint64> stamps(slot.used);
+        for (size_t i = 0; i < slot.used; i++)
+            glGetQueryObjecti64v(slot.queries[i], GL_QUERY_RESULT, &stamps[i]);
+
+        for (size_t i = 0; i < slot.scopes.size(); i++)
+        {
+            const Scope & scope = slot.scopes[i];
+            if (scope.end_query < 0)
+                continue;
+            GpuTiming timing;
+            timing.frame = slot.frame;
+            timing.name = scope.name;
+            timing.start_ns = stamps[scope.begin_query] + m_clock_offset;
+            timing.end_ns = stamps[scope.end_query] + m_clock_offset;
+            timing.depth = scope.depth;
+            m_results.push_back(timing);
+#ifdef ENABLE_PROFILER
+            profiler_gpu_ring().push(timing.name, timing.start_ns, timing.end_ns);
+#endif
+        }
+        slot.scopes.clear();
+    }
+
+    Slot m_slots[LATENCY];
+    long long m_frame;
+    int m_depth;
+    long long m_dropped;
+    long long m_clock_offset;
+    std::vector<GpuTiming> m_results;
+
+    static GpuTimer *& activeTimer()
+    {
+        static GpuTimer * timer = NULL;
+        return timer;
+    }
+};
+
+// scoped GPU zone, does nothing when no GpuTimer is recording
+class GpuZone
+{
+    public:
+    explicit GpuZone(const char * name)
+    {
+        m_timer = GpuTimer::active();
+        if (m_timer)
+            m_scope = m_timer->begin(name);
+    }
+
+    ~GpuZone()
+    {
+        if (m_timer)
+            m_timer->end(m_scope);
+    }
+
+    private:
+    GpuTimer * m_timer;
+    int m_scope;
+};
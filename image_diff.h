@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct ImageDiff
+{
+    size_t mismatched_pixels; // pixels with at least one channel differing by more than the tolerance
+    int max_channel_diff;     // largest per-channel difference over the whole image
+};
+
+// compares two RGBA8 images of pixel_count pixels.
+// a channel matches when |a - b| <= tolerance; a pixel matches when all four channels do.
+inline ImageDiff diff_images(const unsigned char * a, const unsigned char * b, size_t pixel_count, unsigned char tolerance)
+{
+    ImageDiff result;
+    result.mismatched_pixels = 0;
+    result.max_channel_diff = 0;
+
+    size_t i = 0;
+#ifdef __SSE2__
+    // 4 pixels per iteration
+    const __m128i tol = _mm_set1_epi8((char)tolerance);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i max_diff = zero;
+    for (; i + 4 <= pixel_count; i += 4)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i * 4));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i * 4));
+        __m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va)); // |a - b|
+        max_diff = _mm_max_epu8(max_diff, diff);
+
+        __m128i over = _mm_subs_epu8(diff, tol);                   // non-zero where |a - b| > tolerance
+        __m128i pixel_ok = _mm_cmpeq_epi32(over, zero);            // all ones for pixels within tolerance
+        int ok_mask = _mm_movemask_ps(_mm_castsi128_ps(pixel_ok)); // one bit per pixel
+        result.mismatched_pixels += 4 - ((ok_mask & 1) + ((ok_mask >> 1) & 1) + ((ok_mask >> 2) & 1) + ((ok_mask >> 3) & 1));
+    }
+
+    unsigned char lanes[16];
+    _mm_storeu_si128((__m128i *)lanes, max_diff);
+    for (int l = 0; l < 16; l++)
+        if (lanes[l] > result.max_channel_diff)
+            result.max_channel_diff = lanes[l];
+#endif
+
+    // scalar tail (or the whole image without SSE2)
+    for (; i < pixel_count; i++)
+    {
+        bool mismatch = false;
+        for (int c = 0; c < 4; c++)
+        {
+            int d = int(a[i * 4 + c]) - int(b[i * 4 + c]);
+            if (d < 0)
+                d = -d;
+            if (d > result.max_channel_diff)
+                result.max_channel_diff = d;
+            if (d > tolerance)
+                mismatch = true;
+        }
+        if (mismatch)
+            result.mismatched_pixels++;
+    }
+
+    return result;
+}
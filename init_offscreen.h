@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <iostream>
+
+// creates a surfaceless OpenGL 3.3 core context (no window, no display server needed).
+// with LIBGL_ALWAYS_SOFTWARE=1 Mesa renders on the CPU (llvmpipe), so it also works on machines without a GPU.
+// there is no default framebuffer: render into an FBO.
+inline EGLContext init_offscreen()
+{
+  // egl: surfaceless display
+  // ------------------------
+  PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  EGLDisplay display = EGL_NO_DISPLAY;
+  if (eglGetPlatformDisplayEXT)
+    display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  if (display == EGL_NO_DISPLAY)
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major, minor;
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+  {
+    std::cout << "Failed to initialize EGL" << std::endl;
+    exit(1);
+  }
+  eglBindAPI(EGL_OPENGL_API);
+
+  // egl context creation
+  // --------------------
+  const EGLint context_attribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attribs);
+  if (context == EGL_NO_CONTEXT)
+  {
+    std::cout << "Failed to create EGL context" << std::endl;
+    eglTerminate(display);
+    exit(1);
+  }
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+
+  // glad: load all OpenGL function pointers
+  // ---------------------------------------
+  if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+  {
+    std::cout << "Failed to initialize GLAD" << std::endl;
+    exit(1);
+  }
+
+  return context;
+}
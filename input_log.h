@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// binary log of input events, used to replay a session deterministically.
+// file layout: "BTIL" magic, uint32 version, then one record per event:
+//   double time (seconds since the session started), uint8 type, type-specific payload.
+// values are stored in host byte order.
+
+enum InputEventType
+{
+    INPUT_KEY = 0,          // a = key, b = action
+    INPUT_MOUSE_BUTTON = 1, // a = button, b = action
+    INPUT_CURSOR = 2,       // x, y = cursor position
+    INPUT_RESIZE = 3,       // a = width, b = height
+};
+
+struct InputEvent
+{
+    double time;
+    unsigned char type;
+    int a;
+    int b;
+    float x;
+    float y;
+};
+
+static const char INPUT_LOG_MAGIC[4] = { 'B', 'T', 'I', 'L' };
+static const unsigned INPUT_LOG_VERSION = 1;
+
+class InputRecorder
+{
+    public:
+    explicit InputRecorder(const std::string & filename)
+    {
+        file = fopen(filename.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "Could not open input log for writing: \"" << filename << "\"" << std::endl;
+            return;
+        }
+        fwrite(INPUT_LOG_MAGIC, 1, 4, file);
+        fwrite(&INPUT_LOG_VERSION, sizeof(INPUT_LOG_VERSION), 1, file);
+    }
+
+    ~InputRecorder()
+    {
+        if (file)
+            fclose(file);
+    }
+
+    void key(double time, int key, int action) { write(time, INPUT_KEY, (short)key, (unsigned char)action); }
+    void mouseButton(double time, int button, int action) { write(time, INPUT_MOUSE_BUTTON, (unsigned char)button, (unsigned char)action); }
+    void resize(double time, int width, int height) { write(time, INPUT_RESIZE, (unsigned short)width, (unsigned short)height); }
+
+    void cursor(double time, float x, float y)
+    {
+        if (!file)
+            return;
+        writeHeader(time, INPUT_CURSOR);
+        fwrite(&x, sizeof(x), 1, file);
+        fwrite(&y, sizeof(y), 1, file);
+    }
+
+    private:
+    void writeHeader(double time, unsigned char type)
+    {
+        fwrite(&time, sizeof(time), 1, file);
+        fwrite(&type, sizeof(type), 1, file);
+    }
+
+    template <typename A, typename B>
+    void write(double time, unsigned char type, A a, B b)
+    {
+        if (!file)
+            return;
+        writeHeader(time, type);
+        fwrite(&a, sizeof(a), 1, file);
+        fwrite(&b, sizeof(b), 1, file);
+    }
+
+    FILE * file;
+};
+
+class InputReplay
+{
+    public:
+    explicit InputReplay(const std::string & filename)
+    {
+        m_next = 0;
+
+        FILE * file = fopen(filename.c_str(), "rb");
+        if (!file)
+        {
+            std::cout << "Could not open input log: \"" << filename << "\"" << std::endl;
+            return;
+        }
+
+        char magic[4];
+        unsigned version = 0;
+        if (fread(magic, 1, 4, file) != 4 || memcmp(magic, INPUT_LOG_MAGIC, 4) != 0 ||
+            fread(&version, sizeof(version), 1, file) != 1 || version != INPUT_LOG_VERSION)
+        {
+            std::cout << "ERROR::INPUT_LOG:: \"" << filename << "\" is not a version " << INPUT_LOG_VERSION << " input log" << std::endl;
+            fclose(file);
+            return;
+        }
+
+        InputEvent event;
+        while (fread(&event.time, sizeof(event.time), 1, file) == 1 && fread(&event.type, 1, 1, file) == 1)
+        {
+            event.a = event.b = 0;
+            event.x = event.y = 0.0f;
+            bool ok = true;
+            switch (event.type)
+            {
+            case INPUT_KEY:
+                ok = read<short, unsigned char>(file, event);
+                break;
+            case INPUT_MOUSE_BUTTON:
+                ok = read<unsigned char, unsigned char>(file, event);
+                break;
+            case INPUT_RESIZE:
+                ok = read<unsigned short, unsigned short>(file, event);
+                break;
+            case INPUT_CURSOR:
+                ok = fread(&event.x, sizeof(event.x), 1, file) == 1 && fread(&event.y, sizeof(event.y), 1, file) == 1;
+                break;
+            default:
+                ok = false;
+            }
+            if (!ok)
+            {
+                std::cout << "ERROR::INPUT_LOG:: truncated or corrupted event in \"" << filename << "\"" << std::endl;
+                break;
+            }
+            m_events.push_back(event);
+        }
+        fclose(file);
+    }
+
+    // returns the next event with time < until, or NULL if there is none
+    const InputEvent * next(double until)
+    {
+        if (m_next < m_events.size() && m_events[m_next].time < until)
+            return &m_events[m_next++];
+        return NULL;
+    }
+
+    bool finished() const { return m_next >= m_events.size(); }
+    double duration() const { return m_events.empty() ? 0.0 : m_events.back().time; }
+
+    private:
+    template <typename A, typename B>
+    static bool read(FILE * file, InputEvent & event)
+    {
+        A a;
+        B b;
+        if (fread(&a, sizeof(a), 1, file) != 1 || fread(&b, sizeof(b), 1, file) != 1)
+            return false;
+        event.a = a;
+        event.b = b;
+        return true;
+    }
+
+    std::vector<InputEvent> m_events;
+    size_t m_next;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read-only memory mapping of a whole file; the pages are loaded on first access
+// and shared with the page cache, so nothing is copied up front.
+class MappedFile
+{
+    public:
+    explicit MappedFile(const std::string & filename) : m_data(NULL), m_size(0)
+    {
+#ifdef _WIN32
+        m_mapping = NULL;
+        m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER size;
+        if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size))
+        {
+            std::cout << "Could not open file: \"" << filename << "\"" << std::endl;
+            return;
+        }
+        m_size = size_t(size.QuadPart);
+        if (m_size == 0)
+            return;
+        m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_mapping)
+            m_data = (const unsigned char *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0)
+        {
+            std::cout << "Could not open file: \"" << filename << "\"" << std::endl;
+            if (fd >= 0)
+                close(fd);
+            return;
+        }
+        m_size = size_t(info.st_size);
+        if (m_size > 0)
+        {
+            void * data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                madvise(data, m_size, MADV_SEQUENTIAL);
+                m_data = (const unsigned char *)data;
+            }
+        }
+        close(fd); // the mapping keeps the file alive
+#endif
+        if (m_size > 0 && !m_data)
+        {
+            std::cout << "Could not map file: \"" << filename << "\"" << std::endl;
+            m_size = 0;
+        }
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+#else
+        if (m_data)
+            munmap((void *)m_data, m_size);
+#endif
+    }
+
+    bool valid() const { return m_data != NULL; }
+    const unsigned char * data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    private:
+    MappedFile(const MappedFile &);
+    MappedFile & operator=(const MappedFile &);
+
+    const unsigned char * m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#endif
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <ostream>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+// memory accounting of the geometries and of their renderers, in bytes
+struct MemoryStats
+{
+    const char * name;
+    size_t cpu_resident;   // geometry arrays (positions, attributes, indices) held on the CPU
+    size_t gpu_vbo;        // vertex buffer storage
+    size_t gpu_ebo;        // index buffer storage
+    size_t peak_transient; // largest temporary allocation made while uploading
+};
+
+// live entries, registered by their owner for its lifetime.
+// not synchronized: register, unregister and query from the GL thread.
+inline std::vector<const MemoryStats *> & memory_registry()
+{
+    static std::vector<const MemoryStats *> registry;
+    return registry;
+}
+
+inline void memory_register(const MemoryStats * stats)
+{
+    memory_registry().push_back(stats);
+}
+
+inline void memory_unregister(const MemoryStats * stats)
+{
+    std::vector<const MemoryStats *> & registry = memory_registry();
+    registry.erase(std::remove(registry.begin(), registry.end(), stats), registry.end());
+}
+
+// sums of the live entries; peak_transient is the largest one, since uploads do not overlap
+inline MemoryStats memory_totals()
+{
+    MemoryStats total = { "total", 0, 0, 0, 0 };
+    const std::vector<const MemoryStats *> & registry = memory_registry();
+    for (size_t i = 0; i < registry.size(); i++)
+    {
+        total.cpu_resident += registry[i]->cpu_resident;
+        total.gpu_vbo += registry[i]->gpu_vbo;
+        total.gpu_ebo += registry[i]->gpu_ebo;
+        total.peak_transient = std::max(total.peak_transient, registry[i]->peak_transient);
+    }
+    return total;
+}
+
+// resident set size of the whole process, 0 where it is not available
+inline size_t memory_process_rss()
+{
+#ifdef __linux__
+    FILE * file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    unsigned long pages = 0, resident = 0;
+    const bool ok = fscanf(file, "%lu %lu", &pages, &resident) == 2;
+    fclose(file);
+    return ok ? size_t(resident) * size_t(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+inline void memory_print_entry(std::ostream & out, const MemoryStats & stats)
+{
+    out << "{\"name\": \"" << stats.name << "\", \"cpu_resident\": " << stats.cpu_resident
+        << ", \"gpu_vbo\": " << stats.gpu_vbo << ", \"gpu_ebo\": " << stats.gpu_ebo
+        << ", \"peak_transient\": " << stats.peak_transient << "}";
+}
+
+// one JSON object: every live entry, the totals and the process RSS
+inline void memory_dump(std::ostream & out, const char * indent = "")
+{
+    const std::vector<const MemoryStats *> & registry = memory_registry();
+    out << "{" << std::endl;
+    out << indent << "  \"entries\": [" << std::endl;
+    for (size_t i = 0; i < registry.size(); i++)
+    {
+        out << indent << "    ";
+        memory_print_entry(out, *registry[i]);
+        out << (i + 1 < registry.size() ? "," : "") << std::endl;
+    }
+    out << indent << "  ]," << std::endl;
+    out << indent << "  \"total\": ";
+    memory_print_entry(out, memory_totals());
+    out << "," << std::endl;
+    out << indent << "  \"process_rss\": " << memory_process_rss() << std::endl;
+    out << indent << "}";
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "model_renderer.h"
+#include "mapped_file.h"
+#include "assimp_geometry.h"
+#include "ply_geometry.h"
+
+// preprocessed mesh cache, written next to the source as <source>.meshbin after the first import.
+// layout: one MeshCacheHeader, then the interleaved vertex data and the 32-bit index data,
+// each starting on a page boundary so that the mapped ranges go to glBufferData as they are.
+// the cache is rebuilt when the size or the modification time of the source changes, or when
+// the version differs. values are in host byte order.
+
+static const char MESH_CACHE_MAGIC[4] = { 'M', 'B', 'I', 'N' };
+static const uint32_t MESH_CACHE_VERSION = 1;
+static const uint64_t MESH_CACHE_ALIGNMENT = 4096;
+
+struct MeshCacheAttribute
+{
+    uint32_t location;
+    uint32_t size;
+    uint32_t type;
+    uint32_t normalized;
+    uint32_t offset;
+};
+
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime;   // seconds
+
+    uint32_t primitive;     // GL_TRIANGLES...
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t stride;        // bytes
+    uint32_t attribute_count;
+    MeshCacheAttribute attributes[4];
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t padding;
+
+    uint64_t vertex_offset;
+    uint64_t vertex_bytes;
+    uint64_t index_offset;
+    uint64_t index_bytes;
+};
+
+inline uint64_t mesh_cache_align(uint64_t offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+}
+
+inline bool mesh_cache_source_info(const std::string & filename, uint64_t & size, int64_t & mtime)
+{
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0)
+        return false;
+    size = uint64_t(info.st_size);
+    mtime = int64_t(info.st_mtime);
+    return true;
+}
+
+// writes geo as a cache file for a source of the given size and mtime.
+// the file is written under a temporary name and renamed, so concurrent loaders never map a partial cache.
+inline bool mesh_cache_write(IGeometry & geo, const std::string & filename, uint64_t source_size, int64_t source_mtime)
+{
+    const VertexLayout layout = geo.vertexLayout() ? *geo.vertexLayout() : ModelRenderer::interleavedLayout(geo);
+    const size_t vertices_size = size_t(geo.verticesSize());
+
+    std::vector<GLfloat> interleaved;
+    const unsigned char * vertices = (const unsigned char *)geo.interleavedVertices();
+    if (!geo.vertexLayout())
+    {
+        interleaved.resize(vertices_size * ModelRenderer::interleavedStride(geo));
+        ModelRenderer::interleave(geo, interleaved.data());
+        vertices = (const unsigned char *)interleaved.data();
+    }
+
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+    header.version = MESH_CACHE_VERSION;
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+    header.primitive = geo.type();
+    header.vertex_count = uint32_t(vertices_size);
+    header.index_count = uint32_t(geo.size());
+    header.stride = uint32_t(layout.stride);
+    header.attribute_count = uint32_t(layout.count);
+    for (int i = 0; i < layout.count; i++)
+    {
+        header.attributes[i].location = layout.attributes[i].location;
+        header.attributes[i].size = uint32_t(layout.attributes[i].size);
+        header.attributes[i].type = layout.attributes[i].type;
+        header.attributes[i].normalized = layout.attributes[i].normalized;
+        header.attributes[i].offset = uint32_t(layout.attributes[i].offset);
+    }
+
+    // bounds of the positions (location 0, floats)
+    for (int c = 0; c < 3; c++)
+    {
+        header.bounds_min[c] = vertices_size ? 1e30f : 0.0f;
+        header.bounds_max[c] = vertices_size ? -1e30f : 0.0f;
+    }
+    for (int i = 0; i < layout.count; i++)
+        if (layout.attributes[i].location == 0 && layout.attributes[i].type == GL_FLOAT)
+            for (size_t v = 0; v < vertices_size; v++)
+            {
+                GLfloat position[3] = { 0.0f, 0.0f, 0.0f };
+                memcpy(position, vertices + v * layout.stride + layout.attributes[i].offset, sizeof(GLfloat) * std::min(3, int(layout.attributes[i].size)));
+                for (int c = 0; c < 3; c++)
+                {
+                    header.bounds_min[c] = std::min(header.bounds_min[c], position[c]);
+                    header.bounds_max[c] = std::max(header.bounds_max[c], position[c]);
+                }
+            }
+
+    header.vertex_offset = mesh_cache_align(sizeof(header));
+    header.vertex_bytes = uint64_t(vertices_size) * layout.stride;
+    header.index_offset = mesh_cache_align(header.vertex_offset + header.vertex_bytes);
+    header.index_bytes = uint64_t(geo.size()) * sizeof(GLuint);
+
+    const std::string temporary = filename + ".tmp";
+    FILE * file = fopen(temporary.c_str(), "wb");
+    if (!file)
+        return false;
+
+    static const unsigned char ZEROS[MESH_CACHE_ALIGNMENT] = { 0 };
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(ZEROS, 1, size_t(header.vertex_offset - sizeof(header)), file) == header.vertex_offset - sizeof(header);
+    ok = ok && fwrite(vertices, 1, size_t(header.vertex_bytes), file) == header.vertex_bytes;
+    const size_t vertex_padding = size_t(header.index_offset - header.vertex_offset - header.vertex_bytes);
+    ok = ok && fwrite(ZEROS, 1, vertex_padding, file) == vertex_padding;
+    ok = ok && fwrite(geo.faces(), 1, size_t(header.index_bytes), file) == header.index_bytes;
+    ok = fclose(file) == 0 && ok;
+
+#ifdef _WIN32
+    if (ok)
+        remove(filename.c_str()); // rename does not replace on Windows
+#endif
+    ok = ok && rename(temporary.c_str(), filename.c_str()) == 0;
+    if (!ok)
+        remove(temporary.c_str());
+    return ok;
+}
+
+// geometry backed by a mapped .meshbin file: no parsing and no per-vertex copy, the vertex and index
+// ranges of the mapping are uploaded directly. a missing or stale cache is rebuilt from the source
+// (PlyGeometry for .ply files, AssimpGeometry otherwise); if it cannot be written, the imported
+// geometry is used as it is.
+class MeshCacheGeometry : public IGeometry
+{
+public:
+    MeshCacheGeometry(const std::string & source_filename) : m_file(NULL), m_header(NULL), m_source(NULL), m_rebuilt(false)
+    {
+        const std::string cache_filename = source_filename + ".meshbin";
+        uint64_t source_size = 0;
+        int64_t source_mtime = 0;
+        if (!mesh_cache_source_info(source_filename, source_size, source_mtime))
+        {
+            std::cout << "Could not open mesh: \"" << source_filename << "\"" << std::endl;
+            return;
+        }
+
+        if (map(cache_filename, source_size, source_mtime))
+            return;
+
+        // miss: import, write the cache and map it
+        const std::string extension = source_filename.substr(source_filename.find_last_of('.') + 1);
+        if (extension == "ply" || extension == "PLY")
+            m_source = new PlyGeometry(source_filename);
+        else
+            m_source = new AssimpGeometry(source_filename);
+        m_rebuilt = true;
+
+        if (m_source->verticesSize() > 0 && mesh_cache_write(*m_source, cache_filename, source_size, source_mtime) &&
+            map(cache_filename, source_size, source_mtime))
+        {
+            delete m_source;
+            m_source = NULL;
+        }
+        else
+            std::cout << "Could not write mesh cache: \"" << cache_filename << "\"" << std::endl;
+    }
+
+    ~MeshCacheGeometry()
+    {
+        delete m_file;
+        delete m_source;
+    }
+
+    const GLfloat * vertices() { return m_source ? m_source->vertices() : NULL; }
+    const GLfloat * colors() { return m_source ? m_source->colors() : NULL; }
+    const GLfloat * normals() { return m_source ? m_source->normals() : NULL; }
+    const GLfloat * texCoords() { return m_source ? m_source->texCoords() : NULL; }
+    GLsizei verticesSize() { return m_header ? GLsizei(m_header->vertex_count) : m_source ? m_source->verticesSize() : 0; }
+
+    const GLuint * faces()
+    {
+        if (m_header)
+            return (const GLuint *)(m_file->data() + m_header->index_offset);
+        return m_source ? m_source->faces() : NULL;
+    }
+    GLsizei size() { return m_header ? GLsizei(m_header->index_count) : m_source ? m_source->size() : 0; }
+
+    GLenum type() { return m_header ? GLenum(m_header->primitive) : m_source ? m_source->type() : GL_TRIANGLES; }
+
+    const VertexLayout * vertexLayout() { return m_header ? &m_layout : m_source ? m_source->vertexLayout() : NULL; }
+    const void * interleavedVertices()
+    {
+        if (m_header)
+            return m_file->data() + m_header->vertex_offset;
+        return m_source ? m_source->interleavedVertices() : NULL;
+    }
+
+    // the mapped ranges count once they are touched by the upload
+    size_t residentBytes()
+    {
+        if (m_header)
+            return size_t(m_header->vertex_bytes + m_header->index_bytes);
+        return m_source ? m_source->residentBytes() : 0;
+    }
+
+    // bounds of the positions, only known when the cache is mapped
+    bool bounds(glm::vec3 & min, glm::vec3 & max) const
+    {
+        if (!m_header)
+            return false;
+        min = glm::vec3(m_header->bounds_min[0], m_header->bounds_min[1], m_header->bounds_min[2]);
+        max = glm::vec3(m_header->bounds_max[0], m_header->bounds_max[1], m_header->bounds_max[2]);
+        return true;
+    }
+
+    // true when the cache was missing or stale and has been rebuilt from the source
+    bool rebuilt() const { return m_rebuilt; }
+
+private:
+    bool map(const std::string & filename, uint64_t source_size, int64_t source_mtime)
+    {
+        delete m_file;
+        m_file = NULL;
+        m_header = NULL;
+
+        FILE * probe = fopen(filename.c_str(), "rb"); // do not report a missing cache as an error
+        if (!probe)
+            return false;
+        fclose(probe);
+
+        m_file = new MappedFile(filename);
+        const MeshCacheHeader * header = (const MeshCacheHeader *)m_file->data();
+        if (m_file->size() < sizeof(MeshCacheHeader) || memcmp(header->magic, MESH_CACHE_MAGIC, 4) != 0 ||
+            header->version != MESH_CACHE_VERSION || header->source_size != source_size || header->source_mtime != source_mtime ||
+            header->attribute_count > 4 ||
+            header->vertex_offset + header->vertex_bytes > m_file->size() || header->index_offset + header->index_bytes > m_file->size() ||
+            header->vertex_bytes != uint64_t(header->vertex_count) * header->stride || header->index_bytes != uint64_t(header->index_count) * sizeof(GLuint))
+        {
+            delete m_file;
+            m_file = NULL;
+            return false;
+        }
+
+        m_header = header;
+        m_layout.stride = GLsizei(header->stride);
+        m_layout.count = int(header->attribute_count);
+        for (int i = 0; i < m_layout.count; i++)
+        {
+            m_layout.attributes[i].location = header->attributes[i].location;
+            m_layout.attributes[i].size = GLint(header->attributes[i].size);
+            m_layout.attributes[i].type = header->attributes[i].type;
+            m_layout.attributes[i].normalized = GLboolean(header->attributes[i].normalized);
+            m_layout.attributes[i].offset = GLsizei(header->attributes[i].offset);
+        }
+        return true;
+    }
+
+    MappedFile * m_file;
+    const MeshCacheHeader * m_header; // into m_file, NULL when the cache is not mapped
+    VertexLayout m_layout;
+
+    IGeometry * m_source; // fallback when the cache could not be written
+    bool m_rebuilt;
+};
@@ -0,0 +1,329 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "model_renderer.h"
+
+// index optimization run on a geometry before upload (on a loader worker, it touches no GL state):
+//   1. vertex cache order: Tipsify (Sander, Nehab, Barczak 2007), which also splits the triangles
+//      into clusters where it has to jump to a non-adjacent vertex
+//   2. overdraw order: the clusters facing away from the mesh center are drawn first
+//      (an outward-facing cluster is likely to occlude the others)
+//   3. vertex fetch order: vertices are renumbered in order of first use, unused ones dropped
+// the triangle order is kept when the source order already has a lower ACMR (exported optimized).
+// the 16-bit index conversion happens in ModelRenderer, for every geometry with less than 65536 vertices.
+
+const int MESH_OPTIMIZER_CACHE_SIZE = 16; // post-transform cache entries assumed by the reordering and the stats
+
+// post-transform cache statistics of an index buffer, simulating a FIFO cache
+struct VertexCacheStats
+{
+    float acmr; // average cache miss ratio: transformed vertices per triangle (0.5 best, 3 worst)
+    float atvr; // average transformed vertex ratio: transformed vertices per used vertex (1 best)
+};
+
+inline VertexCacheStats vertex_cache_stats(const GLuint * indices, size_t index_count, size_t vertex_count,
+                                           int cache_size = MESH_OPTIMIZER_CACHE_SIZE)
+{
+    std::vector<unsigned> timestamps(vertex_count, 0);
+    std::vector<bool> used(vertex_count, false);
+    unsigned time = cache_size + 1;
+    size_t misses = 0, used_count = 0;
+    for (size_t i = 0; i < index_count; i++)
+    {
+        const GLuint v = indices[i];
+        if (time - timestamps[v] > unsigned(cache_size))
+        {
+            timestamps[v] = time++;
+            misses++;
+        }
+        if (!used[v])
+        {
+            used[v] = true;
+            used_count++;
+        }
+    }
+    VertexCacheStats stats;
+    stats.acmr = index_count ? float(misses) / float(index_count / 3) : 0.0f;
+    stats.atvr = used_count ? float(misses) / float(used_count) : 0.0f;
+    return stats;
+}
+
+// Tipsify: writes the reordered triangles to out (index_count indices) and the index of the first
+// triangle of every cluster to clusters
+inline void tipsify(const GLuint * indices, size_t index_count, size_t vertex_count, int cache_size,
+                    GLuint * out, std::vector<size_t> & clusters)
+{
+    const size_t triangle_count = index_count / 3;
+
+    // triangles around each vertex
+    std::vector<unsigned> live(vertex_count, 0);
+    for (size_t i = 0; i < triangle_count * 3; i++)
+        live[indices[i]]++;
+    std::vector<size_t> adjacency_start(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; v++)
+        adjacency_start[v + 1] = adjacency_start[v] + live[v];
+    std::vector<unsigned> adjacency(triangle_count * 3);
+    std::vector<size_t> fill(adjacency_start.begin(), adjacency_start.end() - 1);
+    for (size_t t = 0; t < triangle_count; t++)
+        for (int c = 0; c < 3; c++)
+            adjacency[fill[indices[t * 3 + c]]++] = unsigned(t);
+
+    std::vector<unsigned> cache_time(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<GLuint> dead_end;
+    std::vector<GLuint> candidates;
+    unsigned time = cache_size + 1;
+    size_t cursor = 0;
+    size_t written = 0;
+
+    clusters.clear();
+    long long fanning = 0;
+    while (fanning < (long long)vertex_count && live[fanning] == 0)
+        fanning++;
+    if (fanning == (long long)vertex_count)
+        return;
+    cursor = size_t(fanning);
+    clusters.push_back(0);
+
+    while (fanning >= 0)
+    {
+        candidates.clear();
+        for (size_t a = adjacency_start[fanning]; a < adjacency_start[fanning + 1]; a++)
+        {
+            const unsigned t = adjacency[a];
+            if (emitted[t])
+                continue;
+            for (int c = 0; c < 3; c++)
+            {
+                const GLuint v = indices[t * 3 + c];
+                out[written++] = v;
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cache_time[v] > unsigned(cache_size))
+                    cache_time[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // next fanning vertex: the candidate still in the cache with the most live triangles,
+        // provided fanning it would not push it out
+        long long best = -1;
+        int best_priority = -1;
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            const GLuint v = candidates[i];
+            if (live[v] == 0)
+                continue;
+            int priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= unsigned(cache_size))
+                priority = int(time - cache_time[v]);
+            if (priority > best_priority)
+            {
+                best_priority = priority;
+                best = v;
+            }
+        }
+
+        if (best < 0)
+        {
+            // dead end: most recent vertex with live triangles, else the next one in input order
+            while (!dead_end.empty() && best < 0)
+            {
+                const GLuint v = dead_end.back();
+                dead_end.pop_back();
+                if (live[v] > 0)
+                    best = v;
+            }
+            while (best < 0 && cursor < vertex_count)
+            {
+                if (live[cursor] > 0)
+                    best = (long long)cursor;
+                cursor++;
+            }
+            if (best >= 0)
+                clusters.push_back(written / 3); // non-local jump: cluster boundary
+        }
+        fanning = best;
+    }
+
+    // drop an empty trailing cluster
+    if (!clusters.empty() && clusters.back() >= written / 3)
+        clusters.pop_back();
+}
+
+// reorders the clusters of triangles (first triangle of each in clusters, as produced by tipsify)
+// from the most to the least outward-facing relative to the mesh centroid. positions: 3 floats per vertex.
+inline void sort_clusters_for_overdraw(GLuint * indices, size_t index_count, const std::vector<glm::vec3> & positions,
+                                       const std::vector<size_t> & clusters)
+{
+    const size_t triangle_count = index_count / 3;
+    if (clusters.size() < 2)
+        return;
+
+    glm::vec3 mesh_centroid(0.0f);
+    float mesh_area = 0.0f;
+    std::vector<float> score(clusters.size());
+    std::vector<glm::vec3> cluster_centroid(clusters.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> cluster_normal(clusters.size(), glm::vec3(0.0f));
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < end; t++)
+        {
+            const glm::vec3 & p0 = positions[indices[t * 3 + 0]];
+            const glm::vec3 & p1 = positions[indices[t * 3 + 1]];
+            const glm::vec3 & p2 = positions[indices[t * 3 + 2]];
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0); // length: twice the area
+            const float triangle_area = glm::length(normal);
+            cluster_centroid[c] += (p0 + p1 + p2) * (triangle_area / 3.0f);
+            cluster_normal[c] += normal;
+            area += triangle_area;
+        }
+        mesh_centroid += cluster_centroid[c];
+        mesh_area += area;
+        cluster_centroid[c] = area > 0.0f ? cluster_centroid[c] / area : positions[indices[clusters[c] * 3]];
+    }
+    if (mesh_area > 0.0f)
+        mesh_centroid /= mesh_area;
+
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        const float length = glm::length(cluster_normal[c]);
+        score[c] = length > 0.0f ? glm::dot(cluster_centroid[c] - mesh_centroid, cluster_normal[c] / length) : 0.0f;
+    }
+
+    std::vector<size_t> order(clusters.size());
+    for (size_t c = 0; c < order.size(); c++)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&score](size_t a, size_t b) { return score[a] > score[b]; });
+
+    std::vector<GLuint> sorted;
+    sorted.reserve(index_count);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const size_t c = order[i];
+        const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+        sorted.insert(sorted.end(), indices + clusters[c] * 3, indices + end * 3);
+    }
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+// renumbers the vertices in order of first use; remap[old] = new, or ~0u when unused.
+// returns the number of used vertices.
+inline size_t optimize_vertex_fetch(GLuint * indices, size_t index_count, size_t vertex_count, std::vector<GLuint> & remap)
+{
+    remap.assign(vertex_count, ~0u);
+    GLuint next = 0;
+    for (size_t i = 0; i < index_count; i++)
+    {
+        GLuint & v = indices[i];
+        if (remap[v] == ~0u)
+            remap[v] = next++;
+        v = remap[v];
+    }
+    return next;
+}
+
+// runs the three passes on any geometry and holds the result as a pre-interleaved geometry, in the
+// source layout (or the float layout of ModelRenderer::interleave), so it can still be compressed.
+// the source can be deleted afterwards.
+class OptimizedGeometry : public IGeometry
+{
+    public:
+    explicit OptimizedGeometry(IGeometry & source, int cache_size = MESH_OPTIMIZER_CACHE_SIZE)
+    {
+        m_type = source.type();
+        const size_t vertex_count = size_t(source.verticesSize());
+        const size_t index_count = size_t(source.size());
+        m_faces.assign(source.faces(), source.faces() + index_count);
+
+        const unsigned char * vertices = (const unsigned char *)source.interleavedVertices();
+        std::vector<GLfloat> interleaved;
+        if (source.vertexLayout())
+            m_layout = *source.vertexLayout();
+        else
+        {
+            m_layout = ModelRenderer::interleavedLayout(source);
+            interleaved.resize(vertex_count * ModelRenderer::interleavedStride(source));
+            ModelRenderer::interleave(source, interleaved.data());
+            vertices = (const unsigned char *)interleaved.data();
+        }
+
+        m_before = vertex_cache_stats(m_faces.data(), index_count, vertex_count, cache_size);
+
+        // only triangle lists have a post-transform cache order and an overdraw order to improve
+        if (m_type == GL_TRIANGLES && index_count >= 3)
+        {
+            std::vector<GLuint> reordered(index_count - index_count % 3);
+            std::vector<size_t> clusters;
+            tipsify(m_faces.data(), reordered.size(), vertex_count, cache_size, reordered.data(), clusters);
+
+            std::vector<glm::vec3> positions;
+            if (readPositions(vertices, vertex_count, positions))
+                sort_clusters_for_overdraw(reordered.data(), reordered.size(), positions, clusters);
+            // sources exported already optimized can be better than Tipsify at this cache size
+            if (vertex_cache_stats(reordered.data(), reordered.size(), vertex_count, cache_size).acmr < m_before.acmr)
+                std::copy(reordered.begin(), reordered.end(), m_faces.begin());
+        }
+
+        std::vector<GLuint> remap;
+        m_vertices_size = GLsizei(optimize_vertex_fetch(m_faces.data(), index_count, vertex_count, remap));
+        m_vertices.resize(size_t(m_vertices_size) * m_layout.stride);
+        for (size_t v = 0; v < vertex_count; v++)
+            if (remap[v] != ~0u)
+                memcpy(&m_vertices[size_t(remap[v]) * m_layout.stride], vertices + v * m_layout.stride, m_layout.stride);
+
+        m_after = vertex_cache_stats(m_faces.data(), index_count, m_vertices_size, cache_size);
+    }
+
+    const GLfloat * vertices() { return NULL; }
+    const GLuint * faces() { return m_faces.data(); }
+    GLsizei verticesSize() { return m_vertices_size; }
+    GLsizei size() { return GLsizei(m_faces.size()); }
+
+    GLenum type() { return m_type; }
+
+    const VertexLayout * vertexLayout() { return &m_layout; }
+    const void * interleavedVertices() { return m_vertices.data(); }
+
+    size_t residentBytes() { return m_vertices.capacity() + m_faces.capacity() * sizeof(GLuint); }
+
+    // post-transform cache statistics of the source order and of the optimized order
+    const VertexCacheStats & statsBefore() const { return m_before; }
+    const VertexCacheStats & statsAfter() const { return m_after; }
+
+    private:
+    // positions as vec3, when location 0 is made of floats
+    bool readPositions(const unsigned char * vertices, size_t vertex_count, std::vector<glm::vec3> & positions) const
+    {
+        for (int i = 0; i < m_layout.count; i++)
+        {
+            const VertexAttribute & attribute = m_layout.attributes[i];
+            if (attribute.location != 0 || attribute.type != GL_FLOAT || attribute.size < 3)
+                continue;
+            positions.resize(vertex_count);
+            for (size_t v = 0; v < vertex_count; v++)
+                memcpy(&positions[v].x, vertices + v * m_layout.stride + attribute.offset, 3 * sizeof(GLfloat));
+            return true;
+        }
+        return false;
+    }
+
+    GLenum m_type;
+    VertexLayout m_layout;
+    std::vector<unsigned char> m_vertices;
+    GLsizei m_vertices_size;
+    std::vector<GLuint> m_faces;
+
+    VertexCacheStats m_before;
+    VertexCacheStats m_after;
+};
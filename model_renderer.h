@@ -2,9 +2,27 @@
 
 #include <glad/glad.h>
 
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "buffer_arena.h"
+#include "gpu_timer.h"
+#include "memory_stats.h"
+#include "vertex_layout.h"
+#include "vertex_compression.h"
+#include "vertex_interleave.h"
+#include "profiler.h"
+
+// geometries own their arrays: they are not copyable, ownership moves with a std::unique_ptr
 class IGeometry
 {
     public:
+    IGeometry() {}
+    IGeometry(const IGeometry &) = delete;
+    IGeometry & operator=(const IGeometry &) = delete;
+
     virtual const GLfloat * vertices() = 0;               // location 0
     virtual const GLfloat * colors() { return NULL; }     // location 1
     virtual const GLfloat * normals() { return NULL; }    // location 2
@@ -16,128 +34,294 @@ class IGeometry
 
     virtual GLenum type() = 0;          // type: GL_TRIANGLES, GL_LINES...
 
+    // geometries that already hold a GPU-ready interleaved vertex buffer return its layout and
+    // verticesSize() * stride bytes of data: the renderer uploads them as they are, without copies.
+    // vertices() and the other per-attribute arrays may then return NULL.
+    virtual const VertexLayout * vertexLayout() { return NULL; }
+    virtual const void * interleavedVertices() { return NULL; }
+
+    // bytes held on the CPU by the arrays above; override when the storage is larger than what is exposed
+    virtual size_t residentBytes()
+    {
+        if (vertexLayout() != NULL)
+            return size_t(verticesSize()) * vertexLayout()->stride + size_t(size()) * sizeof(GLuint);
+        size_t floats = 3;
+        if (colors() != NULL)
+            floats += 3;
+        if (normals() != NULL)
+            floats += 3;
+        if (texCoords() != NULL)
+            floats += 2;
+        return size_t(verticesSize()) * floats * sizeof(GLfloat) + size_t(size()) * sizeof(GLuint);
+    }
+
     virtual ~IGeometry() {}
 };
 
+// what a renderer taking ownership of a geometry does with it after the upload
+enum GeometryRetention
+{
+    RELEASE_GEOMETRY = 0, // deleted right away: the GPU copy is the only one
+    KEEP_GEOMETRY,        // kept for CPU-side queries (picking, collisions), see cpuGeometry()
+};
+
 class ModelRenderer
 {
     public:
-    explicit ModelRenderer(IGeometry & geo)
+    // takes the geometry: uploads it, then releases it or keeps it according to retention
+    ModelRenderer(std::unique_ptr<IGeometry> geo, const char * name, const VertexFormat & format = VertexFormat(),
+                  GeometryRetention retention = RELEASE_GEOMETRY)
+        : ModelRenderer(*geo, name, format)
     {
-        glGenVertexArrays(1, &vao);
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ebo);
+        if (retention == KEEP_GEOMETRY)
+            geometry = std::move(geo);
+        else
+        {
+            geo.reset();
+            memory.cpu_resident = 0;
+        }
+    }
+
+    // the caller keeps the geometry, its arrays are counted as resident until setCpuResident()
+    // name labels the draws in the profiler trace and the GPU timings, it must outlive the renderer.
+    // format selects the GPU vertex format; the default keeps floats and uploads pre-interleaved data as it is.
+    explicit ModelRenderer(IGeometry & geo, const char * name = "ModelRenderer", const VertexFormat & format = VertexFormat())
+    {
+        this->name = name;
+        for (int c = 0; c < 3; c++)
+        {
+            position_scale[c] = 1.0f;
+            position_offset[c] = 0.0f;
+        }
+        octahedral_normal = false;
 
         type = geo.type();
         size = geo.size();
 
         GLuint vertices_size = geo.verticesSize();
 
-        const bool has_colors = geo.colors() != NULL;
-        const bool has_normals = geo.normals() != NULL;
-        const bool has_texCoords = geo.texCoords() != NULL;
-        GLsizei stride = 3;
-        if (has_colors)
-            stride += 3;
-        if (has_normals)
-            stride += 3;
-        if (has_texCoords)
-            stride += 2;
+        const VertexLayout * geo_layout = geo.vertexLayout();
+        VertexLayout layout = geo_layout ? *geo_layout : interleavedLayout(geo);
 
-        GLfloat * vertices = new GLfloat[vertices_size * stride];
-        for (size_t i = 0; i < vertices_size; i++)
+        GLfloat * vertices = NULL;
+        std::vector<unsigned char> compressed;
+        const void * data = geo_layout ? geo.interleavedVertices() : NULL;
+        AttributeStream streams[4];
+        if (format.compressed() && attributeStreams(geo, streams))
         {
-            GLsizei offset = 0;
-            vertices[i * stride + offset++] = geo.vertices()[i * 3 + 0];
-            vertices[i * stride + offset++] = geo.vertices()[i * 3 + 1];
-            vertices[i * stride + offset++] = geo.vertices()[i * 3 + 2];
-
-            if (has_colors)
-            {
-                vertices[i * stride + offset++] = geo.colors()[i * 3 + 0];
-                vertices[i * stride + offset++] = geo.colors()[i * 3 + 1];
-                vertices[i * stride + offset++] = geo.colors()[i * 3 + 2];
-            }
-
-            if (has_normals)
-            {
-                vertices[i * stride + offset++] = geo.normals()[i * 3 + 0];
-                vertices[i * stride + offset++] = geo.normals()[i * 3 + 1];
-                vertices[i * stride + offset++] = geo.normals()[i * 3 + 2];
-            }
+            compress_vertices(format, vertices_size, streams[0], streams[1], streams[2], streams[3],
+                              compressed, layout, position_scale, position_offset);
+            octahedral_normal = streams[2].base != NULL && format.normal == NORMAL_OCTAHEDRAL;
+            data = compressed.data();
+        }
+        else if (!geo_layout)
+        {
+            vertices = new GLfloat[vertices_size * interleavedStride(geo)];
+            interleave(geo, vertices);
+            data = vertices;
+        }
+        const size_t vbo_bytes = size_t(vertices_size) * layout.stride;
+        const bool copied = data != geo.interleavedVertices(); // decided before vertices is freed
 
-            if (has_texCoords)
-            {
-                vertices[i * stride + offset++] = geo.texCoords()[i * 2 + 0];
-                vertices[i * stride + offset++] = geo.texCoords()[i * 2 + 1];
-            }
+        // 16-bit indices whenever they fit: half the EBO and the index fetch bandwidth
+        std::vector<GLushort> short_faces;
+        const void * faces = geo.faces();
+        index_type = GL_UNSIGNED_INT;
+        if (vertices_size < 65536) // 0xffff stays free as a primitive restart index
+        {
+            short_faces.assign(geo.faces(), geo.faces() + size);
+            faces = short_faces.data();
+            index_type = GL_UNSIGNED_SHORT;
         }
+        const size_t ebo_bytes = size_t(size) * indexSize();
 
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, vertices_size * stride * sizeof(GLfloat), vertices, GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        // suballocated from the arena shared by the renderers with the same layout and index type
+        arena = &buffer_arena_for(layout, index_type);
+        allocation = arena->allocate(data, vertices_size, faces, size);
 
         delete[] vertices;
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, size * sizeof(GLuint), geo.faces(), GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-        glBindVertexArray(vao);
+        memory.name = name;
+        memory.cpu_resident = geo.residentBytes();
+        memory.gpu_vbo = vbo_bytes;
+        memory.gpu_ebo = ebo_bytes;
+        memory.peak_transient = (copied ? vbo_bytes : 0) // the interleaved or compressed copy
+                              + short_faces.size() * sizeof(GLushort);
+        memory_register(&memory);
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    // layout of the float buffer filled by interleave(): position, then color, normal, texCoords when present
+    static VertexLayout interleavedLayout(IGeometry & geo)
+    {
+        VertexLayout layout;
+        layout.stride = interleavedStride(geo) * sizeof(GLfloat);
+        layout.count = 0;
         GLsizei offset = 0;
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride * sizeof(GLfloat), (void*)(offset * sizeof(GLfloat)));     // position: location 0
-        glEnableVertexAttribArray(0);
+        const VertexAttribute position = { 0, 3, GL_FLOAT, GL_FALSE, 0 }; // position: location 0
+        layout.attributes[layout.count++] = position;
         offset += 3;
-        if (has_colors)
+        if (geo.colors() != NULL)
         {
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride * sizeof(GLfloat), (void*)(offset * sizeof(GLfloat))); // color: location 1
-            glEnableVertexAttribArray(1);
+            const VertexAttribute color = { 1, 3, GL_FLOAT, GL_FALSE, GLsizei(offset * sizeof(GLfloat)) }; // color: location 1
+            layout.attributes[layout.count++] = color;
             offset += 3;
         }
-        if (has_normals)
+        if (geo.normals() != NULL)
         {
-            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride * sizeof(GLfloat), (void*)(offset * sizeof(GLfloat))); // normals: location 2
-            glEnableVertexAttribArray(2);
+            const VertexAttribute normal = { 2, 3, GL_FLOAT, GL_FALSE, GLsizei(offset * sizeof(GLfloat)) }; // normals: location 2
+            layout.attributes[layout.count++] = normal;
             offset += 3;
         }
-        if (has_texCoords)
+        if (geo.texCoords() != NULL)
         {
-            glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, stride * sizeof(GLfloat), (void*)(offset * sizeof(GLfloat))); // texCoords: location 3
-            glEnableVertexAttribArray(3);
+            const VertexAttribute texCoords = { 3, 2, GL_FLOAT, GL_FALSE, GLsizei(offset * sizeof(GLfloat)) }; // texCoords: location 3
+            layout.attributes[layout.count++] = texCoords;
             offset += 2;
         }
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        return layout;
+    }
+
+    // source attributes by location, for the compression. false when a pre-interleaved
+    // attribute type cannot be read back (only floats and normalized bytes are)
+    static bool attributeStreams(IGeometry & geo, AttributeStream streams[4])
+    {
+        for (int l = 0; l < 4; l++)
+        {
+            streams[l].base = NULL;
+            streams[l].stride = 0;
+            streams[l].type = GL_FLOAT;
+            streams[l].size = 0;
+        }
+
+        const VertexLayout * layout = geo.vertexLayout();
+        if (!layout)
+        {
+            const GLfloat * arrays[4] = { geo.vertices(), geo.colors(), geo.normals(), geo.texCoords() };
+            for (int l = 0; l < 4; l++)
+            {
+                streams[l].base = (const unsigned char *)arrays[l];
+                streams[l].size = l == 3 ? 2 : 3;
+                streams[l].stride = streams[l].size * sizeof(GLfloat);
+            }
+            return streams[0].base != NULL;
+        }
 
-        glBindVertexArray(0);
+        const unsigned char * data = (const unsigned char *)geo.interleavedVertices();
+        for (int i = 0; i < layout->count; i++)
+        {
+            const VertexAttribute & attribute = layout->attributes[i];
+            if (attribute.location > 3 || !(attribute.type == GL_FLOAT || (attribute.type == GL_UNSIGNED_BYTE && attribute.normalized)))
+                return false;
+            streams[attribute.location].base = data + attribute.offset;
+            streams[attribute.location].stride = layout->stride;
+            streams[attribute.location].type = attribute.type;
+            streams[attribute.location].size = attribute.size;
+        }
+        return data != NULL && streams[0].base != NULL;
+    }
+
+    // number of floats per vertex in the interleaved buffer
+    static GLsizei interleavedStride(IGeometry & geo)
+    {
+        GLsizei stride = 3;
+        if (geo.colors() != NULL)
+            stride += 3;
+        if (geo.normals() != NULL)
+            stride += 3;
+        if (geo.texCoords() != NULL)
+            stride += 2;
+        return stride;
+    }
+
+    // fills vertices (verticesSize() * interleavedStride() floats) with position, color, normal, texCoords.
+    // the arrays are fetched once and the kernel for the attributes present is picked once.
+    static void interleave(IGeometry & geo, GLfloat * vertices)
+    {
+        VertexSources sources;
+        sources.positions = geo.vertices();
+        sources.colors = geo.colors();
+        sources.normals = geo.normals();
+        sources.texcoords = geo.texCoords();
+
+        int mask = 0;
+        if (sources.colors != NULL)
+            mask |= VERTEX_COLOR;
+        if (sources.normals != NULL)
+            mask |= VERTEX_NORMAL;
+        if (sources.texcoords != NULL)
+            mask |= VERTEX_TEXCOORD;
+
+        interleave_kernel_for(mask)(sources, size_t(geo.verticesSize()), vertices);
     }
 
     ~ModelRenderer()
     {
-        glDeleteVertexArrays(1, &vao);
-        glDeleteBuffers(1, &vbo);
-        glDeleteBuffers(1, &ebo);
+        memory_unregister(&memory);
+        arena->free(allocation);
+    }
+
+    // bytes of this renderer and of its geometry; cpu_resident is sampled at upload,
+    // call setCpuResident() when the geometry releases or grows its arrays
+    const MemoryStats & memoryStats() const { return memory; }
+    void setCpuResident(size_t bytes) { memory.cpu_resident = bytes; }
+
+    // the geometry kept with KEEP_GEOMETRY, NULL otherwise
+    IGeometry * cpuGeometry() const { return geometry.get(); }
+
+    // drops a kept geometry once the CPU-side queries are done
+    void releaseGeometry()
+    {
+        geometry.reset();
+        memory.cpu_resident = 0;
     }
 
+    // VAO of the arena holding the mesh, shared with the renderers of the same layout
+    GLuint vertexArray() const { return arena->vertexArray(); }
+
+    // GL_UNSIGNED_SHORT when the geometry has less than 65536 vertices, else GL_UNSIGNED_INT
+    GLenum indexType() const { return index_type; }
+    size_t indexSize() const { return index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+
     void render() const
     {
+        PROFILE_ZONE(name);
         renderRange(0, size);
     }
 
+    // decode of the vertex format for esame_10.vert (Object block): position = aPos * scale + offset
+    glm::vec3 positionScale() const { return glm::vec3(position_scale[0], position_scale[1], position_scale[2]); }
+    glm::vec3 positionOffset() const { return glm::vec3(position_offset[0], position_offset[1], position_offset[2]); }
+    bool octahedralNormal() const { return octahedral_normal; }
+
     void renderRange(GLsizei start, GLsizei count) const
     {
-        glBindVertexArray(vao);
-        glDrawElements(type, count, GL_UNSIGNED_INT, (void *)(start * sizeof(GLuint)));
-        glBindVertexArray(0);
+        GpuZone gpu_zone(name);
+        arena->draw(allocation, type, start, count);
+    }
+
+    // every instance of instances in one draw
+    void renderInstanced(const InstanceSource & instances) const
+    {
+        PROFILE_ZONE(name);
+        GpuZone gpu_zone(name);
+        arena->drawInstanced(allocation, type, 0, size, instances);
     }
 
     private:
-    GLuint vao;
-    GLuint vbo;
-    GLuint ebo;
+    BufferArena * arena;
+    BufferArena::Handle allocation;
 
     GLuint size;
     GLenum type;
+    GLenum index_type;
+
+    const char * name;
+    MemoryStats memory;
+    std::unique_ptr<IGeometry> geometry; // KEEP_GEOMETRY only
+
+    // decode of the vertex format
+    GLfloat position_scale[3];
+    GLfloat position_offset[3];
+    bool octahedral_normal;
 };
 
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <vector>
+
+// framebuffer object with a RGBA8 color and a 24-bit depth renderbuffer,
+// used as render target when there is no window
+class OffscreenFramebuffer
+{
+    public:
+    OffscreenFramebuffer(GLsizei width, GLsizei height)
+    {
+        m_width = width;
+        m_height = height;
+
+        glGenFramebuffers(1, &fbo);
+        glGenRenderbuffers(1, &color_rbo);
+        glGenRenderbuffers(1, &depth_rbo);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, color_rbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth_rbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rbo);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: offscreen framebuffer is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    ~OffscreenFramebuffer()
+    {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color_rbo);
+        glDeleteRenderbuffers(1, &depth_rbo);
+    }
+
+    void bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, m_width, m_height);
+    }
+
+    // reads back the color buffer, RGBA8, bottom row first
+    void readPixels(std::vector<unsigned char> & pixels) const
+    {
+        pixels.resize(size_t(m_width) * m_height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+
+    GLsizei width() const { return m_width; }
+    GLsizei height() const { return m_height; }
+
+    private:
+    GLuint fbo;
+    GLuint color_rbo;
+    GLuint depth_rbo;
+
+    GLsizei m_width;
+    GLsizei m_height;
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// persistent workers behind parallel_for: hardware_concurrency - 1 threads, started on first use
+// and kept until exit, so per-frame loops do not create threads. one parallel_for runs on the pool
+// at a time; a call made while the pool is busy runs on its own thread only.
+class ParallelForPool
+{
+    public:
+    static ParallelForPool & instance()
+    {
+        static ParallelForPool pool;
+        return pool;
+    }
+
+    // true on threads whose parallel_for calls run inline: the pool workers, and a thread while it
+    // runs its share of a job, so that nested calls never wait on the pool
+    static bool & inlineThread()
+    {
+        static thread_local bool inline_thread = false;
+        return inline_thread;
+    }
+
+    // the calling thread included
+    size_t threads() const { return m_workers.size() + 1; }
+
+    // runs job on the calling thread and on helpers workers, returns when all of them are done.
+    // false, without running job, when another thread has the pool
+    bool run(const std::function<void()> & job, size_t helpers)
+    {
+        std::unique_lock<std::mutex> busy(m_busy, std::try_to_lock);
+        if (!busy.owns_lock())
+            return false;
+        helpers = std::min(helpers, m_workers.size());
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_job = &job;
+            m_helpers = helpers;
+            m_pending = helpers;
+            m_generation++;
+        }
+        m_wake.notify_all();
+        // parallel_for calls inside job run inline, like on the workers, instead of taking m_busy again
+        const bool was_inline = inlineThread();
+        inlineThread() = true;
+        job();
+        inlineThread() = was_inline;
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_done.wait(lock, [this]() { return m_pending == 0; });
+        m_job = NULL;
+        return true;
+    }
+
+    private:
+    ParallelForPool() : m_job(NULL), m_helpers(0), m_pending(0), m_generation(0), m_stop(false)
+    {
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i + 1 < cores; i++)
+            m_workers.push_back(std::thread(&ParallelForPool::work, this, size_t(i)));
+    }
+
+    ~ParallelForPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (size_t i = 0; i < m_workers.size(); i++)
+            m_workers[i].join();
+    }
+
+    void work(size_t index)
+    {
+        inlineThread() = true;
+        unsigned long long seen = 0;
+        for (;;)
+        {
+            const std::function<void()> * job;
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_wake.wait(lock, [this, seen]() { return m_stop || m_generation != seen; });
+                if (m_stop)
+                    return;
+                seen = m_generation;
+                if (index >= m_helpers)
+                    continue;
+                job = m_job;
+            }
+            (*job)();
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                m_pending--;
+            }
+            m_done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_busy; // held by the parallel_for running on the pool
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void()> * m_job;
+    size_t m_helpers;
+    size_t m_pending;
+    unsigned long long m_generation;
+    bool m_stop;
+};
+
+// threads a parallel_for can use, the calling thread included
+inline size_t parallel_for_threads()
+{
+    return ParallelForPool::inlineThread() ? 1 : ParallelForPool::instance().threads();
+}
+
+// calls body(i) for every i in [0, count) on the pool workers and the calling thread. items are
+// handed out in chunks of grain from a shared counter, so uneven items (meshes of very different
+// sizes) balance across the threads. returns when all are done. nested calls run inline on the
+// calling thread, and so does a call made while another thread has the pool (an AssetLoader worker
+// building while a sibling merges a scene).
+template <typename Body>
+void parallel_for(size_t count, Body body, size_t grain = 1)
+{
+    grain = std::max<size_t>(1, grain);
+    const size_t chunks = (count + grain - 1) / grain;
+    const size_t threads = std::min<size_t>(chunks, parallel_for_threads());
+    if (threads <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            body(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    const std::function<void()> run = [&]() {
+        for (;;)
+        {
+            const size_t begin = next.fetch_add(grain);
+            if (begin >= count)
+                return;
+            const size_t end = std::min(count, begin + grain);
+            for (size_t i = begin; i < end; i++)
+                body(i);
+        }
+    };
+
+    if (!ParallelForPool::instance().run(run, threads - 1))
+        run();
+}
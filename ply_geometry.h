@@ -0,0 +1,490 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "model_renderer.h"
+#include "mapped_file.h"
+
+// binary PLY loader: the file is memory-mapped, the header parsed once and the vertices turned
+// into a GPU-ready interleaved buffer (position and normal as floats, color as normalized uchar).
+// when the vertex records already have that layout (x y z nx ny nz as float, red green blue alpha
+// as uchar, same byte order as the host) the mapping itself is uploaded, without any copy.
+// faces are triangulated as fans; missing normals are computed from the faces.
+
+enum PlyType
+{
+    PLY_NONE = 0,
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64,
+};
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;       // item type for lists
+    PlyType count_type; // PLY_NONE unless the property is a list
+};
+
+struct PlyElement
+{
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> properties;
+};
+
+inline PlyType ply_type(const std::string & name)
+{
+    if (name == "char" || name == "int8") return PLY_INT8;
+    if (name == "uchar" || name == "uint8") return PLY_UINT8;
+    if (name == "short" || name == "int16") return PLY_INT16;
+    if (name == "ushort" || name == "uint16") return PLY_UINT16;
+    if (name == "int" || name == "int32") return PLY_INT32;
+    if (name == "uint" || name == "uint32") return PLY_UINT32;
+    if (name == "float" || name == "float32") return PLY_FLOAT32;
+    if (name == "double" || name == "float64") return PLY_FLOAT64;
+    return PLY_NONE;
+}
+
+inline size_t ply_type_size(PlyType type)
+{
+    static const size_t SIZES[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+    return SIZES[type];
+}
+
+// reads one value at p (unaligned), swapping the bytes when the file byte order differs from the host
+inline double ply_read(const unsigned char * p, PlyType type, bool swap)
+{
+    unsigned char bytes[8];
+    const size_t size = ply_type_size(type);
+    for (size_t i = 0; i < size; i++)
+        bytes[i] = swap ? p[size - 1 - i] : p[i];
+
+    switch (type)
+    {
+    case PLY_INT8: { signed char v; memcpy(&v, bytes, 1); return v; }
+    case PLY_UINT8: return bytes[0];
+    case PLY_INT16: { short v; memcpy(&v, bytes, 2); return v; }
+    case PLY_UINT16: { unsigned short v; memcpy(&v, bytes, 2); return v; }
+    case PLY_INT32: { int v; memcpy(&v, bytes, 4); return v; }
+    case PLY_UINT32: { unsigned v; memcpy(&v, bytes, 4); return v; }
+    case PLY_FLOAT32: { float v; memcpy(&v, bytes, 4); return v; }
+    case PLY_FLOAT64: { double v; memcpy(&v, bytes, 8); return v; }
+    default: return 0.0;
+    }
+}
+
+inline bool ply_host_little_endian()
+{
+    const unsigned short probe = 1;
+    return *(const unsigned char *)&probe == 1;
+}
+
+class PlyGeometry : public IGeometry
+{
+public:
+    PlyGeometry(const std::string & filename) : m_file(filename), m_interleaved(NULL), m_vertices_size(0)
+    {
+        m_layout.stride = 0;
+        m_layout.count = 0;
+        if (!m_file.valid())
+            return;
+
+        std::string error;
+        if (!load(error))
+        {
+            std::cout << "ERROR::PLY:: " << error << " in \"" << filename << "\"" << std::endl;
+            m_interleaved = NULL;
+            m_owned.clear();
+            m_faces.clear();
+            m_vertices_size = 0;
+            m_layout.count = 0;
+        }
+    }
+
+    ~PlyGeometry()
+    {
+    }
+
+    const GLfloat * vertices() { return NULL; }
+    const GLuint * faces() { return m_faces.data(); }
+    GLsizei verticesSize() { return m_vertices_size; }
+    GLsizei size() { return GLsizei(m_faces.size()); }
+
+    GLenum type() { return GL_TRIANGLES; }
+
+    const VertexLayout * vertexLayout() { return &m_layout; }
+    const void * interleavedVertices() { return m_interleaved; }
+
+    // true when the vertex buffer points straight into the mapped file
+    bool zeroCopy() const { return m_interleaved != NULL && m_owned.empty(); }
+
+    // the mapped vertex records count once they are touched by the upload
+    size_t residentBytes()
+    {
+        return (zeroCopy() ? size_t(m_vertices_size) * m_layout.stride : m_owned.capacity()) + m_faces.capacity() * sizeof(GLuint);
+    }
+
+private:
+    bool load(std::string & error)
+    {
+        const unsigned char * end = m_file.data() + m_file.size();
+        std::vector<PlyElement> elements;
+        bool little_endian = true;
+        const unsigned char * cur = parseHeader(elements, little_endian, error);
+        if (!cur)
+            return false;
+        const bool swap = little_endian != ply_host_little_endian();
+
+        bool has_normals = true;
+        for (size_t e = 0; e < elements.size() && cur; e++)
+        {
+            if (elements[e].name == "vertex")
+                cur = readVertices(cur, end, elements[e], swap, has_normals, error);
+            else if (elements[e].name == "face")
+                cur = readFaces(cur, end, elements[e], swap, error);
+            else
+                cur = skipElement(cur, end, elements[e], swap, error);
+        }
+        if (!cur)
+            return false;
+
+        // drop the faces referencing missing vertices
+        size_t kept = 0;
+        for (size_t i = 0; i + 2 < m_faces.size(); i += 3)
+            if (m_faces[i] < GLuint(m_vertices_size) && m_faces[i + 1] < GLuint(m_vertices_size) && m_faces[i + 2] < GLuint(m_vertices_size))
+            {
+                m_faces[kept++] = m_faces[i];
+                m_faces[kept++] = m_faces[i + 1];
+                m_faces[kept++] = m_faces[i + 2];
+            }
+        m_faces.resize(kept);
+
+        if (!has_normals)
+            computeNormals();
+        return true;
+    }
+
+    // returns the first byte after the header, NULL on error
+    const unsigned char * parseHeader(std::vector<PlyElement> & elements, bool & little_endian, std::string & error)
+    {
+        const char * begin = (const char *)m_file.data();
+        const char * end = begin + m_file.size();
+        static const char END_HEADER[] = "end_header";
+        const char * header_end = std::search(begin, end, END_HEADER, END_HEADER + sizeof(END_HEADER) - 1);
+        if (m_file.size() < 4 || memcmp(begin, "ply", 3) != 0 || header_end == end)
+        {
+            error = "not a PLY file";
+            return NULL;
+        }
+        const char * data = std::find(header_end, end, '\n');
+        if (data == end)
+        {
+            error = "truncated header";
+            return NULL;
+        }
+
+        std::istringstream header(std::string(begin, header_end));
+        std::string line;
+        bool has_format = false;
+        while (std::getline(header, line))
+        {
+            std::istringstream tokens(line);
+            std::string keyword;
+            tokens >> keyword;
+            if (keyword == "format")
+            {
+                std::string format;
+                tokens >> format;
+                if (format != "binary_little_endian" && format != "binary_big_endian")
+                {
+                    error = "unsupported format \"" + format + "\" (only binary PLY files are supported)";
+                    return NULL;
+                }
+                little_endian = format == "binary_little_endian";
+                has_format = true;
+            }
+            else if (keyword == "element")
+            {
+                PlyElement element;
+                element.count = 0;
+                tokens >> element.name >> element.count;
+                elements.push_back(element);
+            }
+            else if (keyword == "property" && !elements.empty())
+            {
+                PlyProperty property;
+                std::string type;
+                tokens >> type;
+                property.count_type = PLY_NONE;
+                if (type == "list")
+                {
+                    std::string count_type;
+                    tokens >> count_type >> type;
+                    property.count_type = ply_type(count_type);
+                    if (property.count_type == PLY_NONE || property.count_type == PLY_FLOAT32 || property.count_type == PLY_FLOAT64)
+                    {
+                        error = "unsupported list count type \"" + count_type + "\"";
+                        return NULL;
+                    }
+                }
+                property.type = ply_type(type);
+                tokens >> property.name;
+                if (property.type == PLY_NONE)
+                {
+                    error = "unsupported property type \"" + type + "\"";
+                    return NULL;
+                }
+                elements.back().properties.push_back(property);
+            }
+        }
+        if (!has_format)
+        {
+            error = "missing format line";
+            return NULL;
+        }
+        return (const unsigned char *)data + 1;
+    }
+
+    // bytes of one record, 0 when the element has list properties (variable size)
+    static size_t recordSize(const PlyElement & element)
+    {
+        size_t size = 0;
+        for (size_t p = 0; p < element.properties.size(); p++)
+        {
+            if (element.properties[p].count_type != PLY_NONE)
+                return 0;
+            size += ply_type_size(element.properties[p].type);
+        }
+        return size;
+    }
+
+    // advances past one value or list, NULL when it overruns the file
+    static const unsigned char * skipProperty(const unsigned char * cur, const unsigned char * end, const PlyProperty & property, bool swap)
+    {
+        if (property.count_type == PLY_NONE)
+            return cur + ply_type_size(property.type) <= end ? cur + ply_type_size(property.type) : NULL;
+        if (cur + ply_type_size(property.count_type) > end)
+            return NULL;
+        const size_t count = size_t(ply_read(cur, property.count_type, swap));
+        cur += ply_type_size(property.count_type);
+        return size_t(end - cur) >= count * ply_type_size(property.type) ? cur + count * ply_type_size(property.type) : NULL;
+    }
+
+    static const unsigned char * skipElement(const unsigned char * cur, const unsigned char * end, const PlyElement & element, bool swap, std::string & error)
+    {
+        const size_t record_size = recordSize(element);
+        if (record_size)
+        {
+            if (size_t(end - cur) / record_size < element.count)
+                cur = NULL;
+            else
+                cur += record_size * element.count;
+        }
+        else
+            for (size_t i = 0; i < element.count && cur; i++)
+                for (size_t p = 0; p < element.properties.size() && cur; p++)
+                    cur = skipProperty(cur, end, element.properties[p], swap);
+
+        if (!cur)
+            error = "truncated element \"" + element.name + "\"";
+        return cur;
+    }
+
+    const unsigned char * readVertices(const unsigned char * cur, const unsigned char * end, const PlyElement & element, bool swap,
+                                       bool & has_normals, std::string & error)
+    {
+        // output slots: 0-2 position, 3-5 normal, 6-9 color
+        static const char * SLOT_NAMES[] = { "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue", "alpha" };
+        std::vector<int> slots(element.properties.size(), -1);
+        bool found[10] = { false };
+        for (size_t p = 0; p < element.properties.size(); p++)
+            for (int s = 0; s < 10; s++)
+                if (element.properties[p].name == SLOT_NAMES[s] && element.properties[p].count_type == PLY_NONE)
+                {
+                    slots[p] = s;
+                    found[s] = true;
+                }
+        if (!found[0] || !found[1] || !found[2])
+        {
+            error = "vertices without x, y, z";
+            return NULL;
+        }
+        has_normals = found[3] && found[4] && found[5];
+        const bool has_colors = found[6] && found[7] && found[8];
+
+        m_vertices_size = GLsizei(element.count);
+        m_layout.count = 0;
+        const VertexAttribute position = { 0, 3, GL_FLOAT, GL_FALSE, 0 };
+        const VertexAttribute normal = { 2, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat) };
+        const VertexAttribute color = { 1, 3, GL_UNSIGNED_BYTE, GL_TRUE, 6 * sizeof(GLfloat) };
+        m_layout.attributes[m_layout.count++] = position;
+        m_layout.attributes[m_layout.count++] = normal;
+        if (has_colors)
+            m_layout.attributes[m_layout.count++] = color;
+        m_layout.stride = 6 * sizeof(GLfloat) + (has_colors ? 4 : 0);
+
+        // the records are already in the GPU layout: upload straight from the mapping
+        bool direct = !swap && element.properties.size() == 10;
+        for (size_t p = 0; p < element.properties.size() && direct; p++)
+            direct = slots[p] == int(p) && element.properties[p].type == (p < 6 ? PLY_FLOAT32 : PLY_UINT8);
+        if (direct)
+        {
+            if (size_t(end - cur) / m_layout.stride < element.count)
+            {
+                error = "truncated vertices";
+                return NULL;
+            }
+            m_interleaved = cur;
+            return cur + element.count * m_layout.stride;
+        }
+
+        m_owned.assign(element.count * m_layout.stride, 0);
+        for (size_t i = 0; i < element.count; i++)
+        {
+            unsigned char * out = &m_owned[i * m_layout.stride];
+            GLfloat floats[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+            unsigned char rgba[4] = { 255, 255, 255, 255 };
+            for (size_t p = 0; p < element.properties.size(); p++)
+            {
+                const PlyProperty & property = element.properties[p];
+                const int slot = slots[p];
+                if (slot >= 0 && cur + ply_type_size(property.type) <= end)
+                {
+                    double value = ply_read(cur, property.type, swap);
+                    if (slot < 6)
+                        floats[slot] = GLfloat(value);
+                    else
+                    {
+                        if (property.type == PLY_FLOAT32 || property.type == PLY_FLOAT64)
+                            value *= 255.0;
+                        rgba[slot - 6] = (unsigned char)std::min(255.0, std::max(0.0, value + 0.5));
+                    }
+                }
+                cur = skipProperty(cur, end, property, swap);
+                if (!cur)
+                {
+                    error = "truncated vertices";
+                    return NULL;
+                }
+            }
+            memcpy(out, floats, sizeof(floats));
+            if (has_colors)
+                memcpy(out + sizeof(floats), rgba, 4);
+        }
+        m_interleaved = m_owned.data();
+        return cur;
+    }
+
+    const unsigned char * readFaces(const unsigned char * cur, const unsigned char * end, const PlyElement & element, bool swap, std::string & error)
+    {
+        int indices_property = -1;
+        for (size_t p = 0; p < element.properties.size(); p++)
+            if ((element.properties[p].name == "vertex_indices" || element.properties[p].name == "vertex_index") &&
+                element.properties[p].count_type != PLY_NONE)
+                indices_property = int(p);
+        if (indices_property < 0)
+            return skipElement(cur, end, element, swap, error);
+
+        m_faces.reserve(m_faces.size() + element.count * 3);
+        const PlyProperty & indices = element.properties[indices_property];
+        const size_t index_size = ply_type_size(indices.type);
+        const bool integer_indices = indices.type != PLY_FLOAT32 && indices.type != PLY_FLOAT64;
+        GLuint polygon[64];
+        for (size_t i = 0; i < element.count; i++)
+        {
+            for (size_t p = 0; p < element.properties.size() && cur; p++)
+            {
+                if (int(p) != indices_property)
+                {
+                    cur = skipProperty(cur, end, element.properties[p], swap);
+                    continue;
+                }
+                if (cur + ply_type_size(indices.count_type) > end)
+                {
+                    cur = NULL;
+                    break;
+                }
+                const size_t count = size_t(ply_read(cur, indices.count_type, swap));
+                cur += ply_type_size(indices.count_type);
+                if (size_t(end - cur) < count * index_size)
+                {
+                    cur = NULL;
+                    break;
+                }
+                // 32-bit indices in host order are copied as they are, anything else goes through ply_read
+                if (!swap && index_size == 4 && integer_indices && count <= 64)
+                    memcpy(polygon, cur, count * 4);
+                else
+                    for (size_t k = 0; k < count && k < 64; k++)
+                        polygon[k] = GLuint(ply_read(cur + k * index_size, indices.type, swap));
+                cur += count * index_size;
+
+                for (size_t k = 2; k < count && k < 64; k++) // fan
+                {
+                    m_faces.push_back(polygon[0]);
+                    m_faces.push_back(polygon[k - 1]);
+                    m_faces.push_back(polygon[k]);
+                }
+            }
+            if (!cur)
+            {
+                error = "truncated faces";
+                return NULL;
+            }
+        }
+        return cur;
+    }
+
+    // area-weighted average of the normals of the faces around each vertex
+    void computeNormals()
+    {
+        std::vector<glm::vec3> normals(m_vertices_size, glm::vec3(0.0f));
+        for (size_t i = 0; i + 2 < m_faces.size(); i += 3)
+        {
+            glm::vec3 v0 = position(m_faces[i]);
+            glm::vec3 v1 = position(m_faces[i + 1]);
+            glm::vec3 v2 = position(m_faces[i + 2]);
+            glm::vec3 normal = glm::cross(v1 - v0, v2 - v0);
+            normals[m_faces[i]] += normal;
+            normals[m_faces[i + 1]] += normal;
+            normals[m_faces[i + 2]] += normal;
+        }
+        for (GLsizei v = 0; v < m_vertices_size; v++)
+        {
+            const float length = glm::length(normals[v]);
+            glm::vec3 normal = length > 0.0f ? normals[v] / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            memcpy(&m_owned[v * m_layout.stride + 3 * sizeof(GLfloat)], &normal.x, 3 * sizeof(GLfloat));
+        }
+    }
+
+    glm::vec3 position(GLuint vertex) const
+    {
+        GLfloat xyz[3];
+        memcpy(xyz, &m_owned[vertex * m_layout.stride], sizeof(xyz));
+        return glm::vec3(xyz[0], xyz[1], xyz[2]);
+    }
+
+    MappedFile m_file;
+    const unsigned char * m_interleaved; // into m_file or m_owned
+    std::vector<unsigned char> m_owned;  // converted vertices, empty when uploading from the mapping
+    VertexLayout m_layout;
+    GLsizei m_vertices_size;
+
+    std::vector<GLuint> m_faces;
+};
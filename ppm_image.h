@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// binary PPM (P6) images, kept in memory as RGBA8 with the bottom row first (the glReadPixels layout)
+
+inline bool write_ppm(const std::string & filename, const std::vector<unsigned char> & rgba, int width, int height)
+{
+    FILE * file = fopen(filename.c_str(), "wb");
+    if (!file)
+        return false;
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    std::vector<unsigned char> row(size_t(width) * 3);
+    for (int y = height - 1; y >= 0; y--) // PPM stores the top row first
+    {
+        const unsigned char * src = &rgba[size_t(y) * width * 4];
+        for (int x = 0; x < width; x++)
+        {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        if (fwrite(row.data(), 1, row.size(), file) != row.size())
+        {
+            fclose(file);
+            return false;
+        }
+    }
+    return fclose(file) == 0;
+}
+
+// alpha is set to 255
+inline bool read_ppm(const std::string & filename, std::vector<unsigned char> & rgba, int & width, int & height)
+{
+    FILE * file = fopen(filename.c_str(), "rb");
+    if (!file)
+        return false;
+
+    int max_value = 0;
+    if (fscanf(file, "P6 %d %d %d", &width, &height, &max_value) != 3 || max_value != 255 || fgetc(file) == EOF ||
+        width <= 0 || height <= 0)
+    {
+        fclose(file);
+        return false;
+    }
+
+    rgba.resize(size_t(width) * height * 4);
+    std::vector<unsigned char> row(size_t(width) * 3);
+    for (int y = height - 1; y >= 0; y--)
+    {
+        if (fread(row.data(), 1, row.size(), file) != row.size())
+        {
+            fclose(file);
+            return false;
+        }
+        unsigned char * dst = &rgba[size_t(y) * width * 4];
+        for (int x = 0; x < width; x++)
+        {
+            dst[x * 4 + 0] = row[x * 3 + 0];
+            dst[x * 4 + 1] = row[x * 3 + 1];
+            dst[x * 4 + 2] = row[x * 3 + 2];
+            dst[x * 4 + 3] = 255;
+        }
+    }
+    fclose(file);
+    return true;
+}
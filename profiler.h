@@ -0,0 +1,182 @@
+#pragma once
+
+// scoped CPU timing zones, exported as a Chrome/Perfetto trace (chrome://tracing, ui.perfetto.dev).
+// compile with -DENABLE_PROFILER to enable; otherwise PROFILE_ZONE expands to nothing and
+// profiler_dump() is an empty inline function, so the zones cost nothing.
+//
+//   void display() { PROFILE_ZONE("display"); ... }
+//   profiler_dump("trace.json");
+//
+// zone names must be string literals (only the pointer is stored).
+
+#include <chrono>
+#include <string>
+
+// nanoseconds since the first call, shared clock of the CPU zones and of the GPU timings
+inline long long profiler_now_ns()
+{
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+#ifdef ENABLE_PROFILER
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+struct ProfileEvent
+{
+    const char * name;
+    long long start_ns;
+    long long end_ns;
+};
+
+// single-producer ring buffer: only the owning thread writes, the dump reads.
+// when full, the oldest zones are overwritten.
+class ProfileRing
+{
+    public:
+    static const unsigned CAPACITY = 1 << 16; // power of two
+
+    explicit ProfileRing(int tid) : m_tid(tid), m_head(0) {}
+
+    void push(const char * name, long long start_ns, long long end_ns)
+    {
+        unsigned long long head = m_head.load(std::memory_order_relaxed);
+        ProfileEvent & event = m_events[head & (CAPACITY - 1)];
+        event.name = name;
+        event.start_ns = start_ns;
+        event.end_ns = end_ns;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    // copies the zones currently in the ring; zones overwritten while copying are dropped
+    void snapshot(std::vector<ProfileEvent> & out) const
+    {
+        unsigned long long head = m_head.load(std::memory_order_acquire);
+        unsigned long long first = head > CAPACITY ? head - CAPACITY : 0;
+        size_t start = out.size();
+        for (unsigned long long i = first; i < head; i++)
+            out.push_back(m_events[i & (CAPACITY - 1)]);
+
+        // the producer may have lapped us: discard what it could have overwritten
+        unsigned long long new_head = m_head.load(std::memory_order_acquire);
+        unsigned long long valid_from = new_head > CAPACITY ? new_head - CAPACITY : 0;
+        if (valid_from > first)
+        {
+            size_t stale = size_t(std::min(valid_from - first, head - first));
+            out.erase(out.begin() + start, out.begin() + start + stale);
+        }
+    }
+
+    int tid() const { return m_tid; }
+
+    private:
+    int m_tid;
+    std::atomic<unsigned long long> m_head;
+    ProfileEvent m_events[CAPACITY];
+};
+
+// all rings ever created; a thread registers its ring on its first zone, under the lock
+inline std::vector<ProfileRing *> & profiler_rings(std::mutex ** lock = NULL)
+{
+    static std::mutex rings_lock;
+    static std::vector<ProfileRing *> rings;
+    if (lock)
+        *lock = &rings_lock;
+    return rings;
+}
+
+inline ProfileRing & profiler_thread_ring()
+{
+    thread_local ProfileRing * ring = NULL;
+    if (!ring)
+    {
+        std::mutex * lock;
+        std::vector<ProfileRing *> & rings = profiler_rings(&lock);
+        std::lock_guard<std::mutex> guard(*lock);
+        ring = new ProfileRing(int(rings.size()) + 1);
+        rings.push_back(ring); // never freed: zones stay readable after the thread exits
+    }
+    return *ring;
+}
+
+// track of the GPU timings (tid 0), written by GpuTimer on the GL thread
+inline ProfileRing & profiler_gpu_ring()
+{
+    static ProfileRing * ring = NULL;
+    if (!ring)
+    {
+        std::mutex * lock;
+        std::vector<ProfileRing *> & rings = profiler_rings(&lock);
+        std::lock_guard<std::mutex> guard(*lock);
+        ring = new ProfileRing(0);
+        rings.push_back(ring);
+    }
+    return *ring;
+}
+
+class ProfileZone
+{
+    public:
+    explicit ProfileZone(const char * name) : m_name(name), m_start(profiler_now_ns()) {}
+    ~ProfileZone() { profiler_thread_ring().push(m_name, m_start, profiler_now_ns()); }
+
+    private:
+    const char * m_name;
+    long long m_start;
+};
+
+// writes all recorded zones as Chrome trace JSON, returns false if the file can't be written
+inline bool profiler_dump(const std::string & filename)
+{
+    FILE * file = fopen(filename.c_str(), "w");
+    if (!file)
+    {
+        std::cout << "Could not open trace file for writing: \"" << filename << "\"" << std::endl;
+        return false;
+    }
+
+    std::mutex * lock;
+    std::vector<ProfileRing *> rings;
+    {
+        std::vector<ProfileRing *> & all_rings = profiler_rings(&lock);
+        std::lock_guard<std::mutex> guard(*lock);
+        rings = all_rings;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"GPU\"}}");
+    std::vector<ProfileEvent> events;
+    for (size_t r = 0; r < rings.size(); r++)
+    {
+        events.clear();
+        rings[r]->snapshot(events);
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            // always after another record: the GPU thread name above comes first
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    events[i].name, rings[r]->tid(),
+                    events[i].start_ns / 1000.0, (events[i].end_ns - events[i].start_ns) / 1000.0);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+
+#else
+
+inline bool profiler_dump(const std::string &) { return false; }
+
+#define PROFILE_ZONE(name)
+
+#endif // ENABLE_PROFILER
@@ -0,0 +1,392 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "frame_allocator.h"
+#include "model_renderer.h"
+#include "profiler.h"
+#include "shader_constants.h"
+#include "stream_buffer.h"
+#include "transform_batch.h"
+
+// draws are submitted as packets during the frame, sorted by a 64-bit key, then executed with a
+// state change only where consecutive packets differ.
+//
+//   queue.begin(frame_constants, near, far);
+//   queue.submit(tree, program, &material, model_matrix);
+//   queue.submitInstanced(wing, instanced_program, &material, flock_matrix, &birds, &left_wing);
+//   ...
+//   queue.execute();
+//
+// key, from the most significant bits:
+//   pass (4) | program (12) | vertex array (12) | material (12) | depth (24)
+// opaque packets are sorted front to back (early depth rejection), transparent ones back to front.
+//
+// the constants go through the std140 blocks of shader_constants.h: execute() writes the Frame
+// block, a Material block per material change, an Object block per packet and an Instance block
+// per instanced packet into one range of a StreamBuffer ring, then binds them with
+// glBindBufferRange; a draw costs one range bind instead of a glUniform call per value.
+
+enum RenderPass
+{
+    RENDER_PASS_OPAQUE = 0,
+    RENDER_PASS_TRANSPARENT,
+};
+
+// surface parameters of esame_10.frag, id identifies the material in the sort key
+struct Material
+{
+    unsigned id;
+    GLfloat shininess;
+    glm::vec3 specular;
+    glm::vec3 emitted;
+    bool has_texture; // color from color_texture (unit 0) instead of the vertex colors
+};
+
+struct DrawPacket
+{
+    const ModelRenderer * renderer;
+    GLuint program;
+    const Material * material;
+    glm::mat4 model;
+    const InstanceSource * instances; // NULL: a single draw
+    const InstanceConstants * part;   // instanced draws: where the mesh sits in each instance
+};
+
+const int RENDER_KEY_PASS_BITS = 4;
+const int RENDER_KEY_PROGRAM_BITS = 12;
+const int RENDER_KEY_VERTEX_ARRAY_BITS = 12;
+const int RENDER_KEY_MATERIAL_BITS = 12;
+const int RENDER_KEY_DEPTH_BITS = 24;
+
+inline unsigned long long render_key(RenderPass pass, GLuint program, GLuint vertex_array, unsigned material, float depth01)
+{
+    const unsigned long long depth_max = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+    unsigned long long depth = (unsigned long long)(std::min(1.0f, std::max(0.0f, depth01)) * float(depth_max));
+    if (pass == RENDER_PASS_TRANSPARENT)
+        depth = depth_max - depth;
+
+    unsigned long long key = (unsigned long long)pass & ((1ull << RENDER_KEY_PASS_BITS) - 1);
+    key = (key << RENDER_KEY_PROGRAM_BITS) | (program & ((1u << RENDER_KEY_PROGRAM_BITS) - 1));
+    key = (key << RENDER_KEY_VERTEX_ARRAY_BITS) | (vertex_array & ((1u << RENDER_KEY_VERTEX_ARRAY_BITS) - 1));
+    key = (key << RENDER_KEY_MATERIAL_BITS) | (material & ((1u << RENDER_KEY_MATERIAL_BITS) - 1));
+    key = (key << RENDER_KEY_DEPTH_BITS) | depth;
+    return key;
+}
+
+// what the last execute() did
+struct RenderQueueStats
+{
+    int draws;
+    int program_changes;
+    int material_changes;
+    int vertex_array_changes;
+    size_t uniform_bytes; // written to the uniform ring
+    long long instances;  // objects drawn, counting every instance
+};
+
+class RenderQueue
+{
+    public:
+    RenderQueue()
+        : m_packets(NULL), m_keys(NULL), m_count(0), m_capacity(0), m_constants(), m_near(1.0f), m_far(100.0f),
+          m_uniforms(NULL), m_uniform_mode(STREAM_AUTO), m_uniform_alignment(0)
+    {
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    ~RenderQueue() { release(); }
+
+    // frees the uniform ring, while the context is current
+    void release()
+    {
+        delete m_uniforms;
+        m_uniforms = NULL;
+    }
+
+    // mapping of the uniform ring, taken into account when it is (re)created: captures need
+    // STREAM_ORPHAN, whose writes go through glMapBufferRange/glUnmapBuffer
+    void setUniformMode(StreamMode mode)
+    {
+        m_uniform_mode = mode;
+        release();
+    }
+
+    // starts a frame: drops the previous packets, depth is measured along the view direction in [near, far]
+    void begin(const FrameConstants & constants, float near_plane, float far_plane)
+    {
+        m_frame.reset();
+        m_packets = NULL;
+        m_keys = NULL;
+        m_count = 0;
+        m_capacity = 0;
+        m_constants = constants;
+        m_near = near_plane;
+        m_far = far_plane;
+    }
+
+    // renderers that are not loaded yet (NULL) are skipped
+    void submit(const ModelRenderer * renderer, GLuint program, const Material * material, const glm::mat4 & model,
+                RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        push(renderer, program, material, model, NULL, NULL, pass);
+    }
+
+    // instances->count copies of the renderer in one draw, model places the whole set (the flock);
+    // instances and part must live until execute(). sorted by the depth of model's origin.
+    void submitInstanced(const ModelRenderer * renderer, GLuint program, const Material * material, const glm::mat4 & model,
+                         const InstanceSource * instances, const InstanceConstants * part, RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        if (instances->count > 0)
+            push(renderer, program, material, model, instances, part, pass);
+    }
+
+
+    void execute()
+    {
+        PROFILE_ZONE("RenderQueue::execute");
+        // the submission index breaks ties: equal keys draw in submission order
+        std::sort(m_keys, m_keys + m_count, [](const SortItem & a, const SortItem & b) {
+            return a.key != b.key ? a.key < b.key : a.index < b.index;
+        });
+
+        memset(&m_stats, 0, sizeof(m_stats));
+        if (!m_count)
+            return;
+        const size_t * offsets = writeUniforms();
+        if (!offsets)
+            return;
+        m_stats.instances = 0;
+        const GLuint buffer = m_uniforms->buffer();
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, buffer, offsets[0], sizeof(FrameConstants));
+
+        GLuint program = 0;
+        const Material * material = NULL;
+        GLuint vertex_array = 0;
+        for (size_t i = 0; i < m_count; i++)
+        {
+            const DrawPacket & packet = m_packets[m_keys[i].index];
+            if (!program || packet.program != program)
+            {
+                program = packet.program;
+                glUseProgram(program);
+                bindBlocks(program);
+                m_stats.program_changes++;
+            }
+            if (packet.material != material)
+            {
+                material = packet.material;
+                glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, buffer, offsets[3 * i + 1], sizeof(MaterialConstants));
+                m_stats.material_changes++;
+            }
+            if (packet.renderer->vertexArray() != vertex_array)
+            {
+                vertex_array = packet.renderer->vertexArray();
+                m_stats.vertex_array_changes++;
+            }
+
+            glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BLOCK_BINDING, buffer, offsets[3 * i + 2], sizeof(ObjectConstants));
+            if (packet.instances)
+            {
+                glBindBufferRange(GL_UNIFORM_BUFFER, INSTANCE_BLOCK_BINDING, buffer, offsets[3 * i + 3], sizeof(InstanceConstants));
+                packet.renderer->renderInstanced(*packet.instances);
+                m_stats.instances += packet.instances->count;
+            }
+            else
+            {
+                packet.renderer->render();
+                m_stats.instances++;
+            }
+            m_stats.draws++;
+        }
+        m_uniforms->endFrame();
+    }
+
+    size_t size() const { return m_count; }
+    const RenderQueueStats & stats() const { return m_stats; }
+    const FrameAllocator & frameAllocator() const { return m_frame; }
+
+    private:
+    RenderQueue(const RenderQueue &);
+    RenderQueue & operator=(const RenderQueue &);
+
+    struct SortItem
+    {
+        unsigned long long key;
+        unsigned index;
+    };
+
+    void push(const ModelRenderer * renderer, GLuint program, const Material * material, const glm::mat4 & model,
+              const InstanceSource * instances, const InstanceConstants * part, RenderPass pass)
+    {
+        if (!renderer)
+            return;
+        if (m_count == m_capacity)
+            grow();
+
+        DrawPacket & packet = m_packets[m_count];
+        packet.renderer = renderer;
+        packet.program = program;
+        packet.material = material;
+        packet.model = model;
+        packet.instances = instances;
+        packet.part = part;
+
+        const float depth = -(m_constants.view * model[3]).z; // of the model origin
+        SortItem & item = m_keys[m_count];
+        item.key = render_key(pass, program, renderer->vertexArray(), material->id, (depth - m_near) / (m_far - m_near));
+        item.index = unsigned(m_count);
+        m_count++;
+    }
+
+    // the block bindings of a program are assigned the first time it is executed
+    void bindBlocks(GLuint program)
+    {
+        if (std::find(m_programs.begin(), m_programs.end(), program) != m_programs.end())
+            return;
+        bind_uniform_blocks(program);
+        m_programs.push_back(program);
+    }
+
+    size_t uniformSlot(size_t bytes) const { return (bytes + m_uniform_alignment - 1) / m_uniform_alignment * m_uniform_alignment; }
+
+    // writes the blocks of the sorted packets to the ring: the Frame, the Materials, the Objects
+    // contiguous so that transform_batch() fills their matrices in one pass, then the Instances.
+    // returns the buffer offsets, in the frame allocator: [0] Frame, [3 i + 1] Material,
+    // [3 i + 2] Object and [3 i + 3] Instance of the i-th sorted packet. NULL when the ring could
+    // not be mapped.
+    const size_t * writeUniforms()
+    {
+        if (!m_uniform_alignment)
+        {
+            GLint alignment = 0;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment); // at most 256, the ring region alignment
+            m_uniform_alignment = size_t(std::max(alignment, GLint(16)));
+        }
+
+        size_t materials = 0, instanced = 0;
+        const Material * material = NULL;
+        for (size_t i = 0; i < m_count; i++)
+        {
+            const DrawPacket & packet = m_packets[m_keys[i].index];
+            if (packet.material != material)
+            {
+                material = packet.material;
+                materials++;
+            }
+            if (packet.instances)
+                instanced++;
+        }
+        const size_t object_slot = uniformSlot(sizeof(ObjectConstants));
+        const size_t objects_at = uniformSlot(sizeof(FrameConstants)) + materials * uniformSlot(sizeof(MaterialConstants));
+        const size_t instances_at = objects_at + m_count * object_slot;
+        const size_t bytes = instances_at + instanced * uniformSlot(sizeof(InstanceConstants));
+
+        // the ring grows with the scene; the old buffer is released by GL once its draws are done
+        if (!m_uniforms || m_uniforms->frameBytes() < bytes)
+        {
+            const size_t frame_bytes = std::max<size_t>(64 * 1024, m_uniforms ? std::max(bytes, m_uniforms->frameBytes() * 2) : bytes);
+            delete m_uniforms;
+            m_uniforms = new StreamBuffer(frame_bytes, m_uniform_mode);
+        }
+
+        glm::mat4 * models = m_frame.allocate<glm::mat4>(m_count);
+        for (size_t i = 0; i < m_count; i++)
+            models[i] = m_packets[m_keys[i].index].model;
+
+        unsigned char * data = (unsigned char *)m_uniforms->map(bytes, m_uniform_alignment);
+        if (!data)
+            return NULL;
+        {
+            PROFILE_ZONE("transform_batch");
+            transform_batch(m_constants.projection, m_constants.view, models, m_count, data + objects_at, object_slot);
+        }
+
+        size_t * offsets = m_frame.allocate<size_t>(3 * m_count + 1);
+        size_t at = 0;
+        memcpy(data, &m_constants, sizeof(FrameConstants));
+        offsets[0] = at;
+        at += uniformSlot(sizeof(FrameConstants));
+
+        material = NULL;
+        size_t material_offset = 0;
+        size_t instance_at = instances_at;
+        for (size_t i = 0; i < m_count; i++)
+        {
+            const DrawPacket & packet = m_packets[m_keys[i].index];
+            if (packet.material != material)
+            {
+                material = packet.material;
+                MaterialConstants constants = MaterialConstants();
+                constants.specular = glm::vec4(material->specular, 0.0f);
+                constants.emitted = glm::vec4(material->emitted, 0.0f);
+                constants.shininess = material->shininess;
+                constants.has_texture = material->has_texture;
+                memcpy(data + at, &constants, sizeof(constants));
+                material_offset = at;
+                at += uniformSlot(sizeof(MaterialConstants));
+            }
+
+            // the matrices are already there
+            ObjectConstants & object = *(ObjectConstants *)(data + objects_at + i * object_slot);
+            object.position_scale = glm::vec4(packet.renderer->positionScale(), 0.0f);
+            object.position_offset = glm::vec4(packet.renderer->positionOffset(), 0.0f);
+            object.octahedral_normal = packet.renderer->octahedralNormal();
+            offsets[3 * i + 1] = material_offset;
+            offsets[3 * i + 2] = objects_at + i * object_slot;
+
+            offsets[3 * i + 3] = 0;
+            if (packet.instances)
+            {
+                memcpy(data + instance_at, packet.part, sizeof(InstanceConstants));
+                offsets[3 * i + 3] = instance_at;
+                instance_at += uniformSlot(sizeof(InstanceConstants));
+            }
+        }
+        m_uniforms->unmap(bytes);
+        m_stats.uniform_bytes = bytes;
+
+        const size_t base = m_uniforms->lastOffset();
+        for (size_t i = 0; i < 3 * m_count + 1; i++)
+            offsets[i] += base;
+        return offsets;
+    }
+
+    // doubles the arrays in the frame allocator; the old ones are dropped with the frame
+    void grow()
+    {
+        const size_t capacity = std::max<size_t>(64, m_capacity * 2);
+        DrawPacket * packets = m_frame.allocate<DrawPacket>(capacity);
+        SortItem * keys = m_frame.allocate<SortItem>(capacity);
+        if (m_count)
+        {
+            memcpy(packets, m_packets, m_count * sizeof(DrawPacket));
+            memcpy(keys, m_keys, m_count * sizeof(SortItem));
+        }
+        m_packets = packets;
+        m_keys = keys;
+        m_capacity = capacity;
+    }
+
+    FrameAllocator m_frame;
+    DrawPacket * m_packets;
+    SortItem * m_keys;
+    size_t m_count;
+    size_t m_capacity;
+
+    FrameConstants m_constants;
+    float m_near;
+    float m_far;
+
+    StreamBuffer * m_uniforms;  // created by the first execute()
+    StreamMode m_uniform_mode;
+    size_t m_uniform_alignment; // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    std::vector<GLuint> m_programs;
+    RenderQueueStats m_stats;
+};
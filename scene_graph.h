@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "profiler.h"
+
+// transform hierarchy of the scene, stored flat: a node is an index, nodes are added after their
+// parent, so parents always come first and one forward pass updates the world matrices.
+//
+//   SceneGraph scene;
+//   const int root = scene.add(SCENE_NO_PARENT, glm::mat4(1.0f));
+//   const int tree = scene.add(root, glm::mat4(1.0f));
+//   ...
+//   scene.setLocal(root, rotation); // marks root dirty if the matrix changed
+//   scene.update();                 // recomputes root and its subtree only
+//   draw(scene.world(tree));
+//
+// setLocal() only marks a node dirty when its matrix actually changes, and update() starts at the
+// first dirty node: a frame where nothing moved costs no matrix product at all.
+
+const int SCENE_NO_PARENT = -1;
+
+class SceneGraph
+{
+    public:
+    SceneGraph() : m_first_dirty(0), m_updated(0) {}
+
+    // appends a node under parent (SCENE_NO_PARENT for a root) and returns its index
+    int add(int parent, const glm::mat4 & local)
+    {
+        const int node = int(m_parents.size());
+        if (parent >= node)
+        {
+            std::cout << "ERROR::SCENE_GRAPH:: parent " << parent << " added after its child " << node << std::endl;
+            parent = SCENE_NO_PARENT;
+        }
+        m_parents.push_back(parent);
+        m_locals.push_back(local);
+        m_worlds.push_back(local);
+        m_dirty.push_back(1);
+        m_first_dirty = std::min(m_first_dirty, node);
+        return node;
+    }
+
+    // returns true if the matrix changed, and the node is then updated by the next update()
+    bool setLocal(int node, const glm::mat4 & local)
+    {
+        if (!memcmp(&m_locals[node], &local, sizeof(glm::mat4)))
+            return false;
+        m_locals[node] = local;
+        m_dirty[node] = 1;
+        m_first_dirty = std::min(m_first_dirty, node);
+        return true;
+    }
+
+    // recomputes the world matrices of the dirty nodes and their subtrees, in one pass from the first
+    // dirty node. m_dirty doubles as "world changed": a node is recomputed if it or its parent is set.
+    void update()
+    {
+        PROFILE_ZONE("SceneGraph::update");
+        m_updated = 0;
+        const int count = int(m_parents.size());
+        for (int node = m_first_dirty; node < count; node++)
+        {
+            const int parent = m_parents[node];
+            if (!m_dirty[node] && (parent == SCENE_NO_PARENT || !m_dirty[parent]))
+                continue;
+            m_worlds[node] = parent == SCENE_NO_PARENT ? m_locals[node] : m_worlds[parent] * m_locals[node];
+            m_dirty[node] = 1;
+            m_updated++;
+        }
+        for (int node = m_first_dirty; node < count; node++)
+            m_dirty[node] = 0;
+        m_first_dirty = count;
+    }
+
+    const glm::mat4 & local(int node) const { return m_locals[node]; }
+    // as of the last update()
+    const glm::mat4 & world(int node) const { return m_worlds[node]; }
+    int parent(int node) const { return m_parents[node]; }
+    int size() const { return int(m_parents.size()); }
+    // world matrices recomputed by the last update()
+    int updated() const { return m_updated; }
+
+    private:
+    std::vector<int> m_parents;
+    std::vector<glm::mat4> m_locals;
+    std::vector<glm::mat4> m_worlds;
+    std::vector<unsigned char> m_dirty;
+    int m_first_dirty; // no node before it is dirty
+    int m_updated;
+};
@@ -0,0 +1,51 @@
+// declarations shared by the shaders, inserted after their #version line by createShaderProgram().
+// the std140 blocks are mirrored by shader_constants.h: change both together.
+
+// camera and light, once per frame
+layout (std140) uniform Frame
+{
+   mat4 projection;
+   mat4 view;
+   vec4 light_position; // camera space
+   vec4 light_ambient;
+   vec4 light_diffuse;
+   vec4 light_specular;
+   int state_tree;
+};
+
+layout (std140) uniform Material
+{
+   vec4 color_specular;
+   vec4 color_emitted;
+   float shininess;
+   bool has_texture;
+};
+
+// per draw: the object, or the whole set of an instanced draw (the flock, the forest)
+layout (std140) uniform Object
+{
+   mat4 transformation;
+   mat4 modelview;
+   mat3 normal_matrix; // transpose(inverse(mat3(modelview))), computed on the CPU (transform_batch.h)
+   // vertex format decode (see vertex_compression.h): quantized positions are aPos * position_scale + position_offset,
+   // octahedral normals come as two components in aNormal.xy
+   vec4 position_scale;
+   vec4 position_offset;
+   bool octahedral_normal;
+};
+
+// instanced draws: where the mesh sits in each instance, and how much it follows the hinge angle
+layout (std140) uniform Instance
+{
+   mat4 part;
+   mat3 part_normal_matrix;
+   vec4 hinge;
+};
+
+vec3 decode_octahedral(vec2 e)
+{
+   vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+   if (n.z < 0.0)
+     n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+   return normalize(n);
+}
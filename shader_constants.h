@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <iostream>
+
+// C++ mirrors of the std140 uniform blocks of esame_10.vert, esame_10.frag and bird_instanced.vert. members are vec4
+// and mat4 or groups of 4 scalars so that the C++ layout is the std140 one without hidden padding.
+
+enum UniformBlockBinding
+{
+    FRAME_BLOCK_BINDING = 0,
+    MATERIAL_BLOCK_BINDING,
+    OBJECT_BLOCK_BINDING,
+    INSTANCE_BLOCK_BINDING,
+};
+
+// block Frame: camera and light, once per frame
+struct FrameConstants
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 light_position; // camera space
+    glm::vec4 light_ambient;
+    glm::vec4 light_diffuse;
+    glm::vec4 light_specular;
+    GLint state_tree;
+    GLint padding[3];
+};
+
+// block Material
+struct MaterialConstants
+{
+    glm::vec4 specular;
+    glm::vec4 emitted;
+    GLfloat shininess;
+    GLint has_texture;
+    GLint padding[2];
+};
+
+// block Object: per draw
+struct ObjectConstants
+{
+    glm::mat4 transformation;
+    glm::mat4 modelview;
+    glm::vec4 normal_matrix[3]; // std140 mat3: three columns padded to vec4
+    glm::vec4 position_scale;  // vertex format decode, see vertex_compression.h
+    glm::vec4 position_offset;
+    GLint octahedral_normal;
+    GLint padding[3];
+};
+
+// block Instance: instanced draws, where the mesh sits in each instance (a part of the bird)
+struct InstanceConstants
+{
+    glm::mat4 part;                  // mesh to instance space, after the hinge
+    glm::vec4 part_normal_matrix[3]; // transpose(inverse(mat3(part)))
+    glm::vec4 hinge;                 // x: factor of the instance's hinge angle (rotation about x), 0 for rigid parts
+};
+
+static_assert(sizeof(FrameConstants) == 208, "FrameConstants does not match the std140 Frame block");
+static_assert(sizeof(MaterialConstants) == 48, "MaterialConstants does not match the std140 Material block");
+static_assert(sizeof(ObjectConstants) == 224, "ObjectConstants does not match the std140 Object block");
+static_assert(sizeof(InstanceConstants) == 128, "InstanceConstants does not match the std140 Instance block");
+
+// assigns the binding points of the blocks the program declares (GLSL 330 has no layout(binding)).
+// Frame, Material and Object are required, Instance only exists in the instanced programs.
+inline void bind_uniform_blocks(GLuint program)
+{
+    const char * names[] = { "Frame", "Material", "Object", "Instance" };
+    const GLuint bindings[] = { FRAME_BLOCK_BINDING, MATERIAL_BLOCK_BINDING, OBJECT_BLOCK_BINDING, INSTANCE_BLOCK_BINDING };
+    for (int i = 0; i < 4; i++)
+    {
+        const GLuint index = glGetUniformBlockIndex(program, names[i]);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, bindings[i]);
+        else if (bindings[i] != INSTANCE_BLOCK_BINDING)
+            std::cout << "ERROR::SHADER::PROGRAM:: uniform block " << names[i] << " not found" << std::endl;
+    }
+}
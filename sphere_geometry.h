@@ -11,10 +11,10 @@
 class SphereGeometry : public IGeometry
 {
 public:
-    SphereGeometry(float radius, glm::vec3 color)
+    SphereGeometry(float radius, glm::vec3 color, int samples_lat = 24, int samples_lon = 24)
     {
-        const int SAMPLES_LAT = 24;
-        const int SAMPLES_LON = 24;
+        const int SAMPLES_LAT = samples_lat;
+        const int SAMPLES_LON = samples_lon;
         m_vertices = new GLfloat[3 * ((SAMPLES_LAT - 2) * SAMPLES_LON + 2)];
         m_colors = new GLfloat[3 * ((SAMPLES_LAT - 2) * SAMPLES_LON + 2)];
         m_normals = new GLfloat[3 * ((SAMPLES_LAT - 2) * SAMPLES_LON + 2)];
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// ring buffer for data rewritten every frame (animated vertices, per-instance data), split in
+// STREAM_BUFFER_FRAMES regions so the CPU writes one region while the GPU reads the previous ones.
+//
+//   StreamBuffer stream(bytes_per_frame);
+//   void * p = stream.map(bytes);     // write the frame's data
+//   stream.unmap(bytes);
+//   ... draw from stream.buffer() at stream.lastOffset() ...
+//   stream.endFrame();                // after the draws of the frame
+//
+// persistent: glBufferStorage, mapped once (persistent, coherent); a fence per region, waited on
+// when the ring comes back to it, which only blocks if the GPU is more than two frames behind.
+// orphan (plain GL 3.3): each range is mapped unsynchronized, and the storage is orphaned with
+// glBufferData when the ring wraps, so the driver never waits on the draws of the previous cycle.
+// the buffer is only bound to GL_COPY_WRITE_BUFFER here, which leaves the VAO bindings alone.
+
+const int STREAM_BUFFER_FRAMES = 3;
+const size_t STREAM_BUFFER_ALIGNMENT = 256; // regions start on it: covers the uniform buffer offset alignments
+
+enum StreamMode
+{
+    STREAM_AUTO = 0,   // persistent when available
+    STREAM_PERSISTENT,
+    STREAM_ORPHAN,
+};
+
+inline bool gl_has_extension(const char * name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char * extension = (const char *)glGetStringi(GL_EXTENSIONS, GLuint(i));
+        if (extension && !strcmp(extension, name))
+            return true;
+    }
+    return false;
+}
+
+inline bool gl_has_buffer_storage()
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return glBufferStorage != NULL && (major * 10 + minor >= 44 || gl_has_extension("GL_ARB_buffer_storage"));
+}
+
+class StreamBuffer
+{
+    public:
+    // frame_bytes: capacity of one frame's region
+    explicit StreamBuffer(size_t frame_bytes, StreamMode mode = STREAM_AUTO)
+        : m_frame_bytes(align(frame_bytes)), m_frame(0), m_head(0), m_last_offset(0), m_mapped(NULL), m_persistent(NULL)
+    {
+        for (int i = 0; i < STREAM_BUFFER_FRAMES; i++)
+            m_fences[i] = 0;
+
+        if (mode == STREAM_AUTO)
+            mode = gl_has_buffer_storage() ? STREAM_PERSISTENT : STREAM_ORPHAN;
+        else if (mode == STREAM_PERSISTENT && !gl_has_buffer_storage())
+        {
+            std::cout << "ERROR::STREAM_BUFFER:: persistent mapping not supported, orphaning instead" << std::endl;
+            mode = STREAM_ORPHAN;
+        }
+        m_mode = mode;
+
+        glGenBuffers(1, &m_buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        if (m_mode == STREAM_PERSISTENT)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, capacity(), NULL, flags);
+            m_persistent = (unsigned char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity(), flags);
+            if (!m_persistent)
+            {
+                // glBufferStorage storage is immutable, orphaning needs a new buffer
+                std::cout << "ERROR::STREAM_BUFFER:: persistent mapping failed, orphaning instead" << std::endl;
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+                glDeleteBuffers(1, &m_buffer);
+                glGenBuffers(1, &m_buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+                m_mode = STREAM_ORPHAN;
+            }
+        }
+        if (m_mode == STREAM_ORPHAN)
+            glBufferData(GL_COPY_WRITE_BUFFER, capacity(), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    ~StreamBuffer()
+    {
+        for (int i = 0; i < STREAM_BUFFER_FRAMES; i++)
+            if (m_fences[i])
+                glDeleteSync(m_fences[i]);
+        if (m_persistent)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &m_buffer);
+    }
+
+    // write pointer for bytes in the current frame's region, at an offset multiple of alignment
+    // (a power of two up to STREAM_BUFFER_ALIGNMENT), NULL when the region is full.
+    // the data may be read by GL only after unmap().
+    void * map(size_t bytes, size_t alignment = 16)
+    {
+        const size_t start = (m_head + alignment - 1) & ~(alignment - 1);
+        if (start + bytes > m_frame_bytes)
+        {
+            std::cout << "ERROR::STREAM_BUFFER:: " << bytes << " bytes do not fit in the " << m_frame_bytes - std::min(start, m_frame_bytes) << " left this frame" << std::endl;
+            return NULL;
+        }
+        if (m_head == 0)
+            waitFrame();
+        m_head = start;
+
+        if (m_persistent)
+            m_mapped = m_persistent + offset();
+        else
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+            m_mapped = (unsigned char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, offset(), bytes,
+                                                         GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        return m_mapped;
+    }
+
+    // ends the writes started by map(); written bytes are kept, the next map() starts after them
+    void unmap(size_t written)
+    {
+        if (!m_mapped)
+            return;
+        if (!m_persistent)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        m_mapped = NULL;
+        m_last_offset = offset();
+        m_head += written;
+    }
+
+    // byte offset in buffer() of the data written by the last map()/unmap()
+    size_t lastOffset() const { return m_last_offset; }
+
+    // after the frame's draws: fences the region and moves to the next one
+    void endFrame()
+    {
+        if (m_mode == STREAM_PERSISTENT)
+        {
+            if (m_fences[m_frame])
+                glDeleteSync(m_fences[m_frame]);
+            m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        m_frame = (m_frame + 1) % STREAM_BUFFER_FRAMES;
+        m_head = 0;
+        if (m_mode == STREAM_ORPHAN && m_frame == 0)
+        {
+            // orphan on every wrap, whether region 0 gets mapped or not: the unsynchronized maps of
+            // the new cycle must never land in storage the previous cycle's draws still read
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, capacity(), NULL, GL_STREAM_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+    }
+
+    GLuint buffer() const { return m_buffer; }
+    StreamMode mode() const { return m_mode; }
+    size_t frameBytes() const { return m_frame_bytes; }
+
+    private:
+    StreamBuffer(const StreamBuffer &);
+    StreamBuffer & operator=(const StreamBuffer &);
+
+    static size_t align(size_t bytes) { return (bytes + STREAM_BUFFER_ALIGNMENT - 1) / STREAM_BUFFER_ALIGNMENT * STREAM_BUFFER_ALIGNMENT; }
+
+    size_t capacity() const { return m_frame_bytes * STREAM_BUFFER_FRAMES; }
+    size_t offset() const { return m_frame * m_frame_bytes + m_head; }
+
+    // persistent: the GPU must be done with the draws that read this region STREAM_BUFFER_FRAMES frames ago
+    void waitFrame()
+    {
+        GLsync fence = m_fences[m_frame];
+        if (!fence)
+            return;
+        GLbitfield flags = 0;
+        for (;;)
+        {
+            const GLenum status = glClientWaitSync(fence, flags, 1000000); // 1 ms
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED)
+                break;
+            flags = GL_SYNC_FLUSH_COMMANDS_BIT; // the fence may not have been submitted yet
+        }
+        glDeleteSync(fence);
+        m_fences[m_frame] = 0;
+    }
+
+    GLuint m_buffer;
+    StreamMode m_mode;
+    size_t m_frame_bytes;
+    int m_frame;                   // region being written
+    size_t m_head;                 // bytes used in that region
+    size_t m_last_offset;
+    unsigned char * m_mapped;      // current write range
+    unsigned char * m_persistent;  // whole buffer, persistent mode
+    GLsync m_fences[STREAM_BUFFER_FRAMES];
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "shader_constants.h"
+
+// transform stage of the frame: the model matrices of all the draws are turned into the matrices of
+// their Object blocks in one pass, instead of one glm product chain per draw.
+//
+//   transformation = projection * view * model
+//   modelview      = view * model
+//   normal_matrix  = transpose(inverse(mat3(modelview)))
+//
+// the normal matrix is the cofactor matrix of mat3(modelview) divided by its determinant: its
+// columns are the cross products of the columns of mat3(modelview), no general inverse needed.
+// results are written to the ObjectConstants at out + i * stride (the stride of the uniform ring
+// slots); the other members are left alone.
+
+inline void transform_one_scalar(const glm::mat4 & projection_view, const glm::mat4 & view, const glm::mat4 & model, ObjectConstants & out)
+{
+    out.modelview = view * model;
+    out.transformation = projection_view * model;
+
+    const glm::vec3 c0(out.modelview[0]), c1(out.modelview[1]), c2(out.modelview[2]);
+    glm::vec3 n0 = glm::cross(c1, c2), n1 = glm::cross(c2, c0), n2 = glm::cross(c0, c1);
+    const float det = glm::dot(c0, n0);
+    if (std::fabs(det) > 1e-30f) // degenerate: the shader normalizes anyway
+    {
+        n0 /= det;
+        n1 /= det;
+        n2 /= det;
+    }
+    out.normal_matrix[0] = glm::vec4(n0, 0.0f);
+    out.normal_matrix[1] = glm::vec4(n1, 0.0f);
+    out.normal_matrix[2] = glm::vec4(n2, 0.0f);
+}
+
+#ifdef __SSE__
+// column-major product of a (4 columns) with the column b
+inline __m128 transform_column_sse(const __m128 a[4], const float * b)
+{
+    __m128 r = _mm_mul_ps(a[0], _mm_set1_ps(b[0]));
+    r = _mm_add_ps(r, _mm_mul_ps(a[1], _mm_set1_ps(b[1])));
+    r = _mm_add_ps(r, _mm_mul_ps(a[2], _mm_set1_ps(b[2])));
+    return _mm_add_ps(r, _mm_mul_ps(a[3], _mm_set1_ps(b[3])));
+}
+
+// a x b on xyz; w is a.w * b.w - a.w * b.w = 0
+inline __m128 transform_cross_sse(__m128 a, __m128 b)
+{
+    const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+#endif
+
+inline void transform_batch(const glm::mat4 & projection, const glm::mat4 & view, const glm::mat4 * models, size_t count,
+                            void * out, size_t stride)
+{
+    const glm::mat4 projection_view = projection * view;
+    unsigned char * o = (unsigned char *)out;
+#ifdef __SSE__
+    __m128 pv[4], v[4];
+    for (int c = 0; c < 4; c++)
+    {
+        pv[c] = _mm_loadu_ps(&projection_view[c][0]);
+        v[c] = _mm_loadu_ps(&view[c][0]);
+    }
+    for (size_t i = 0; i < count; i++, o += stride)
+    {
+        ObjectConstants & object = *(ObjectConstants *)o;
+        const float * model = &models[i][0][0];
+        __m128 mv[4];
+        for (int c = 0; c < 4; c++)
+        {
+            mv[c] = transform_column_sse(v, model + c * 4);
+            _mm_storeu_ps(&object.modelview[c][0], mv[c]);
+            _mm_storeu_ps(&object.transformation[c][0], transform_column_sse(pv, model + c * 4));
+        }
+
+        // the w lanes of the cross products are 0, so they drop out of the determinant too
+        const __m128 c0 = mv[0], c1 = mv[1], c2 = mv[2];
+        __m128 n0 = transform_cross_sse(c1, c2), n1 = transform_cross_sse(c2, c0), n2 = transform_cross_sse(c0, c1);
+        __m128 det = _mm_mul_ps(c0, n0);
+        det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2, 3, 0, 1)));
+        det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1, 0, 3, 2))); // sum in every lane
+        if (std::fabs(_mm_cvtss_f32(det)) > 1e-30f)
+        {
+            const __m128 inverse_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+            n0 = _mm_mul_ps(n0, inverse_det);
+            n1 = _mm_mul_ps(n1, inverse_det);
+            n2 = _mm_mul_ps(n2, inverse_det);
+        }
+        _mm_storeu_ps(&object.normal_matrix[0][0], n0);
+        _mm_storeu_ps(&object.normal_matrix[1][0], n1);
+        _mm_storeu_ps(&object.normal_matrix[2][0], n2);
+    }
+#else
+    for (size_t i = 0; i < count; i++, o += stride)
+        transform_one_scalar(projection_view, view, models[i], *(ObjectConstants *)o);
+#endif
+}
@@ -0,0 +1,38 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in vec3 aNormal;
+layout (location = 3) in vec2 aTexCoords;
+// the uniform blocks and decode_octahedral() come from shader_common.glsl
+
+// per tree (TreeInstance in forest_instances.h)
+layout (location = 4) in vec4 aTreePosition; // xyz: position in the forest space, w: rotation about z
+layout (location = 5) in vec4 aTreeTint;     // rgb: canopy color factor, w: scale
+
+out vec2 vTexCoords;
+out vec3 vNormal;
+out vec3 vPosition;
+out vec3 vColor;
+out vec3 vTint;
+
+void main()
+{
+   vec3 pos = aPos * position_scale.xyz + position_offset.xyz;
+   vec3 normal = octahedral_normal ? decode_octahedral(aNormal.xy) : aNormal;
+
+   // tree = translate(position) * rotate(rotation, z) * scale(scale), then the part
+   float rotation = aTreePosition.w;
+   mat3 tree_rotation = mat3(cos(rotation), sin(rotation), 0.0, -sin(rotation), cos(rotation), 0.0, 0.0, 0.0, 1.0);
+
+   vec3 tree_pos = aTreePosition.xyz + aTreeTint.w * (tree_rotation * (part * vec4(pos, 1.0)).xyz);
+   gl_Position = transformation * vec4(tree_pos, 1.0);
+   vec4 position = modelview * vec4(tree_pos, 1.0);
+   vPosition = position.xyz / position.w;
+   // a rotation and a uniform scale: their own inverse transpose, up to a factor normalize() removes
+   vNormal = normal_matrix * (tree_rotation * (part_normal_matrix * normal));
+   if (has_texture)
+     vTexCoords = aTexCoords;
+   else
+     vColor = aColor;
+   vTint = aTreeTint.rgb;
+}
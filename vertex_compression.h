@@ -0,0 +1,271 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "vertex_layout.h"
+
+// compressed GPU vertex formats, selected per renderer. the decode that is not done by the vertex
+// fetch itself (bounding-box dequantization, octahedral normals) is in esame_10.vert.
+//
+//   position  float: 12 bytes   half: 8 bytes (3 + padding)   unorm16 in the bounding box: 8 bytes
+//   normal    float: 12 bytes   GL_INT_2_10_10_10_REV: 4 bytes   octahedral snorm16 x2: 4 bytes
+//   color     float: 12 bytes   unorm8: 4 bytes
+//   texcoord  float: 8 bytes    half: 4 bytes
+
+enum PositionFormat
+{
+    POSITION_FLOAT = 0,
+    POSITION_HALF,
+    POSITION_UNORM16, // quantized in the bounding box, decoded with position_scale/position_offset
+};
+
+enum NormalFormat
+{
+    NORMAL_FLOAT = 0,
+    NORMAL_INT_2_10_10_10,
+    NORMAL_OCTAHEDRAL, // decoded with octahedral_normal
+};
+
+struct VertexFormat
+{
+    PositionFormat position;
+    NormalFormat normal;
+    bool unorm8_colors;
+    bool half_texcoords;
+
+    VertexFormat(PositionFormat position = POSITION_FLOAT, NormalFormat normal = NORMAL_FLOAT,
+                 bool unorm8_colors = false, bool half_texcoords = false)
+        : position(position), normal(normal), unorm8_colors(unorm8_colors), half_texcoords(half_texcoords) {}
+
+    bool compressed() const { return position != POSITION_FLOAT || normal != NORMAL_FLOAT || unorm8_colors || half_texcoords; }
+
+    // smallest of each
+    static VertexFormat compact() { return VertexFormat(POSITION_UNORM16, NORMAL_INT_2_10_10_10, true, true); }
+};
+
+// round to nearest even, with denormals, infinities and NaN
+inline unsigned short float_to_half(float value)
+{
+    unsigned bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const unsigned sign = (bits >> 16) & 0x8000;
+    const int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+    unsigned mantissa = bits & 0x7fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff) // inf, NaN
+        return (unsigned short)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    if (exponent >= 31) // overflow
+        return (unsigned short)(sign | 0x7c00);
+    if (exponent <= 0) // denormal or zero
+    {
+        if (exponent < -10)
+            return (unsigned short)sign;
+        mantissa |= 0x800000;
+        const int shift = 14 - exponent;
+        unsigned half = mantissa >> shift;
+        const unsigned rest = mantissa & ((1u << shift) - 1);
+        const unsigned halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return (unsigned short)(sign | half);
+    }
+
+    unsigned half = (unsigned(exponent) << 10) | (mantissa >> 13);
+    const unsigned rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++; // may carry into the exponent, which is the correct rounding
+    return (unsigned short)(sign | half);
+}
+
+// x, y, z in [-1, 1] as signed normalized 10-bit values, w = 0
+inline GLuint pack_int_2_10_10_10(float x, float y, float z)
+{
+    const float v[3] = { x, y, z };
+    GLuint packed = 0;
+    for (int c = 0; c < 3; c++)
+    {
+        const int q = int(std::floor(std::min(1.0f, std::max(-1.0f, v[c])) * 511.0f + 0.5f));
+        packed |= (GLuint(q) & 0x3ff) << (10 * c);
+    }
+    return packed;
+}
+
+// unit vector to the octahedron unfolded on [-1, 1]^2, as two snorm16
+inline void encode_octahedral(float x, float y, float z, short out[2])
+{
+    const float l1 = std::fabs(x) + std::fabs(y) + std::fabs(z);
+    float u = l1 > 0.0f ? x / l1 : 0.0f;
+    float v = l1 > 0.0f ? y / l1 : 0.0f;
+    if (z < 0.0f)
+    {
+        const float fu = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        const float fv = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = fu;
+        v = fv;
+    }
+    out[0] = short(std::floor(std::min(1.0f, std::max(-1.0f, u)) * 32767.0f + 0.5f));
+    out[1] = short(std::floor(std::min(1.0f, std::max(-1.0f, v)) * 32767.0f + 0.5f));
+}
+
+// a source attribute: size components of type (GL_FLOAT, or GL_UNSIGNED_BYTE normalized) every stride bytes
+struct AttributeStream
+{
+    const unsigned char * base; // NULL when absent
+    GLsizei stride;
+    GLenum type;
+    int size;
+
+    void read(size_t vertex, float out[4]) const
+    {
+        const unsigned char * p = base + vertex * stride;
+        out[0] = out[1] = out[2] = 0.0f;
+        out[3] = 1.0f;
+        for (int c = 0; c < size && c < 4; c++)
+        {
+            if (type == GL_FLOAT)
+                memcpy(&out[c], p + c * sizeof(GLfloat), sizeof(GLfloat));
+            else
+                out[c] = p[c] / 255.0f;
+        }
+    }
+};
+
+// encodes count vertices into the layout chosen by format (positions required, the other streams
+// optional) and describes it in layout. position_scale/position_offset receive the position decode.
+inline void compress_vertices(const VertexFormat & format, size_t count,
+                              const AttributeStream & positions, const AttributeStream & colors,
+                              const AttributeStream & normals, const AttributeStream & texcoords,
+                              std::vector<unsigned char> & out, VertexLayout & layout,
+                              float position_scale[3], float position_offset[3])
+{
+    layout.count = 0;
+    GLsizei offset = 0;
+    const GLsizei position_bytes = format.position == POSITION_FLOAT ? 12 : 8;
+    layout.attributes[layout.count].location = 0;
+    layout.attributes[layout.count].size = 3;
+    layout.attributes[layout.count].type = format.position == POSITION_FLOAT ? GL_FLOAT : format.position == POSITION_HALF ? GL_HALF_FLOAT : GL_UNSIGNED_SHORT;
+    layout.attributes[layout.count].normalized = format.position == POSITION_UNORM16;
+    layout.attributes[layout.count++].offset = offset;
+    offset += position_bytes;
+
+    GLsizei color_offset = 0, normal_offset = 0, texcoord_offset = 0;
+    if (colors.base)
+    {
+        color_offset = offset;
+        layout.attributes[layout.count].location = 1;
+        layout.attributes[layout.count].size = 3;
+        layout.attributes[layout.count].type = format.unorm8_colors ? GL_UNSIGNED_BYTE : GL_FLOAT;
+        layout.attributes[layout.count].normalized = format.unorm8_colors;
+        layout.attributes[layout.count++].offset = offset;
+        offset += format.unorm8_colors ? 4 : 12;
+    }
+    if (normals.base)
+    {
+        normal_offset = offset;
+        layout.attributes[layout.count].location = 2;
+        layout.attributes[layout.count].size = format.normal == NORMAL_FLOAT ? 3 : format.normal == NORMAL_INT_2_10_10_10 ? 4 : 2;
+        layout.attributes[layout.count].type = format.normal == NORMAL_FLOAT ? GL_FLOAT : format.normal == NORMAL_INT_2_10_10_10 ? GL_INT_2_10_10_10_REV : GL_SHORT;
+        layout.attributes[layout.count].normalized = format.normal != NORMAL_FLOAT;
+        layout.attributes[layout.count++].offset = offset;
+        offset += format.normal == NORMAL_FLOAT ? 12 : 4;
+    }
+    if (texcoords.base)
+    {
+        texcoord_offset = offset;
+        layout.attributes[layout.count].location = 3;
+        layout.attributes[layout.count].size = 2;
+        layout.attributes[layout.count].type = format.half_texcoords ? GL_HALF_FLOAT : GL_FLOAT;
+        layout.attributes[layout.count].normalized = GL_FALSE;
+        layout.attributes[layout.count++].offset = offset;
+        offset += format.half_texcoords ? 4 : 8;
+    }
+    layout.stride = offset;
+
+    // bounding box for the quantized positions
+    float min[3] = { 0.0f, 0.0f, 0.0f }, max[3] = { 0.0f, 0.0f, 0.0f };
+    float value[4];
+    for (size_t v = 0; v < count; v++)
+    {
+        positions.read(v, value);
+        for (int c = 0; c < 3; c++)
+        {
+            min[c] = v ? std::min(min[c], value[c]) : value[c];
+            max[c] = v ? std::max(max[c], value[c]) : value[c];
+        }
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        position_scale[c] = format.position == POSITION_UNORM16 ? max[c] - min[c] : 1.0f;
+        position_offset[c] = format.position == POSITION_UNORM16 ? min[c] : 0.0f;
+    }
+
+    out.assign(count * layout.stride, 0);
+    for (size_t v = 0; v < count; v++)
+    {
+        unsigned char * vertex = &out[v * layout.stride];
+
+        positions.read(v, value);
+        if (format.position == POSITION_FLOAT)
+            memcpy(vertex, value, 12);
+        else
+        {
+            unsigned short q[3];
+            for (int c = 0; c < 3; c++)
+            {
+                if (format.position == POSITION_HALF)
+                    q[c] = float_to_half(value[c]);
+                else
+                {
+                    const float t = position_scale[c] > 0.0f ? (value[c] - min[c]) / position_scale[c] : 0.0f;
+                    q[c] = (unsigned short)std::floor(std::min(1.0f, std::max(0.0f, t)) * 65535.0f + 0.5f);
+                }
+            }
+            memcpy(vertex, q, sizeof(q));
+        }
+
+        if (colors.base)
+        {
+            colors.read(v, value);
+            if (format.unorm8_colors)
+                for (int c = 0; c < 3; c++)
+                    vertex[color_offset + c] = (unsigned char)std::floor(std::min(1.0f, std::max(0.0f, value[c])) * 255.0f + 0.5f);
+            else
+                memcpy(vertex + color_offset, value, 12);
+        }
+
+        if (normals.base)
+        {
+            normals.read(v, value);
+            if (format.normal == NORMAL_FLOAT)
+                memcpy(vertex + normal_offset, value, 12);
+            else if (format.normal == NORMAL_INT_2_10_10_10)
+            {
+                const GLuint packed = pack_int_2_10_10_10(value[0], value[1], value[2]);
+                memcpy(vertex + normal_offset, &packed, 4);
+            }
+            else
+            {
+                short octahedral[2];
+                encode_octahedral(value[0], value[1], value[2], octahedral);
+                memcpy(vertex + normal_offset, octahedral, 4);
+            }
+        }
+
+        if (texcoords.base)
+        {
+            texcoords.read(v, value);
+            if (format.half_texcoords)
+            {
+                const unsigned short half[2] = { float_to_half(value[0]), float_to_half(value[1]) };
+                memcpy(vertex + texcoord_offset, half, 4);
+            }
+            else
+                memcpy(vertex + texcoord_offset, value, 8);
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstring>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+// interleaving kernels, one per combination of attributes, with the stride known at compile time.
+// the source arrays are fetched once by the caller; the kernels only stream through them.
+
+// attributes present besides the position, as a kernel index
+enum VertexAttributeMask
+{
+    VERTEX_COLOR = 1,
+    VERTEX_NORMAL = 2,
+    VERTEX_TEXCOORD = 4,
+    VERTEX_MASK_COUNT = 8,
+};
+
+struct VertexSources
+{
+    const GLfloat * positions; // 3 floats per vertex
+    const GLfloat * colors;    // 3 floats per vertex, or NULL
+    const GLfloat * normals;   // 3 floats per vertex, or NULL
+    const GLfloat * texcoords; // 2 floats per vertex, or NULL
+};
+
+template <bool COLOR, bool NORMAL, bool TEXCOORD>
+struct InterleavedVertex
+{
+    static const int STRIDE = 3 + (COLOR ? 3 : 0) + (NORMAL ? 3 : 0) + (TEXCOORD ? 2 : 0); // floats
+};
+
+template <bool COLOR, bool NORMAL, bool TEXCOORD>
+inline void interleave_vertex_scalar(const VertexSources & src, size_t i, GLfloat * out)
+{
+    memcpy(out, src.positions + i * 3, 3 * sizeof(GLfloat));
+    out += 3;
+    if (COLOR)
+    {
+        memcpy(out, src.colors + i * 3, 3 * sizeof(GLfloat));
+        out += 3;
+    }
+    if (NORMAL)
+    {
+        memcpy(out, src.normals + i * 3, 3 * sizeof(GLfloat));
+        out += 3;
+    }
+    if (TEXCOORD)
+        memcpy(out, src.texcoords + i * 2, 2 * sizeof(GLfloat));
+}
+
+// SSE: every 3-float attribute is moved with one 4-float load and store. the fourth lane spills into
+// the next slot, which is written right after (stores go in increasing address order), so only the
+// last vertex, whose loads and stores could run past the arrays, takes the scalar path.
+template <bool COLOR, bool NORMAL, bool TEXCOORD>
+inline void interleave_kernel(const VertexSources & src, size_t count, GLfloat * out)
+{
+    const int STRIDE = InterleavedVertex<COLOR, NORMAL, TEXCOORD>::STRIDE;
+    size_t i = 0;
+#ifdef __SSE__
+    for (; i + 1 < count; i++)
+    {
+        GLfloat * o = out + i * STRIDE;
+        _mm_storeu_ps(o, _mm_loadu_ps(src.positions + i * 3));
+        o += 3;
+        if (COLOR)
+        {
+            _mm_storeu_ps(o, _mm_loadu_ps(src.colors + i * 3));
+            o += 3;
+        }
+        if (NORMAL)
+        {
+            _mm_storeu_ps(o, _mm_loadu_ps(src.normals + i * 3));
+            o += 3;
+        }
+        if (TEXCOORD)
+            _mm_storel_pi((__m64 *)o, _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(src.texcoords + i * 2)));
+    }
+#endif
+    for (; i < count; i++)
+        interleave_vertex_scalar<COLOR, NORMAL, TEXCOORD>(src, i, out + i * STRIDE);
+}
+
+typedef void (*InterleaveKernel)(const VertexSources & src, size_t count, GLfloat * out);
+
+// kernel for a VertexAttributeMask combination
+inline InterleaveKernel interleave_kernel_for(int mask)
+{
+    static const InterleaveKernel KERNELS[VERTEX_MASK_COUNT] = {
+        interleave_kernel<false, false, false>,
+        interleave_kernel<true, false, false>,
+        interleave_kernel<false, true, false>,
+        interleave_kernel<true, true, false>,
+        interleave_kernel<false, false, true>,
+        interleave_kernel<true, false, true>,
+        interleave_kernel<false, true, true>,
+        interleave_kernel<true, true, true>,
+    };
+    return KERNELS[mask & (VERTEX_MASK_COUNT - 1)];
+}
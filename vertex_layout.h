@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// one attribute of an interleaved vertex buffer, as passed to glVertexAttribPointer
+struct VertexAttribute
+{
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei offset; // bytes
+};
+
+struct VertexLayout
+{
+    GLsizei stride; // bytes
+    int count;
+    VertexAttribute attributes[4];
+};
+
+inline bool vertex_layout_equal(const VertexLayout & a, const VertexLayout & b)
+{
+    if (a.stride != b.stride || a.count != b.count)
+        return false;
+    for (int i = 0; i < a.count; i++)
+    {
+        const VertexAttribute & x = a.attributes[i];
+        const VertexAttribute & y = b.attributes[i];
+        if (x.location != y.location || x.size != y.size || x.type != y.type || x.normalized != y.normalized || x.offset != y.offset)
+            return false;
+    }
+    return true;
+}